@@ -0,0 +1,242 @@
+/*
+ *
+ * NAME:
+ *   launchbench  -  measure how fast small_shell launches commands
+ *
+ * SYNTAX:
+ *   launchbench [-s shell] [-a arg] [-m mode] [-n launches] [-w window]
+ *               [-c command]
+ *
+ * DESCRIPTION:
+ *   launchbench runs the shell interactively on pipes, types command lines
+ *   at it and reads what it reports.  The latency of a launch is the time
+ *   from writing the line until the shell reports the process as
+ *   terminated, that is prompt to reap.  At the end it prints launches per
+ *   second and the distribution of the latencies.
+ *
+ * OPTIONS:
+ *   -s shell      the shell to run (default ./small_shell), it is given -i
+ *   -a arg        one more argument for the shell, e.g. -z
+ *   -m mode       fg: every command in the foreground, bg: every command
+ *                 in the background, mixed: every other one in the
+ *                 background (default fg)
+ *   -n launches   commands to launch (default 10000)
+ *   -w window     background commands running at most (default 64)
+ *   -c command    the command to launch (default /bin/true), a simple
+ *                 command, no builtin and without pipes or redirections
+ *
+ * EXAMPLES:
+ *   launchbench -m bg -n 20000
+ *   launchbench -m mixed -c "./loop 1"
+ *   launchbench -a -z
+ *
+ *   The result has the form
+ *
+ *     fg 10000 launches in 2.145 s, 4662 launches/s
+ *     latency ms: min 0.151 p50 0.198 p90 0.247 p99 0.512 max 3.020
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "shellpipe.h"
+
+#define FG    1
+#define BG    2
+#define MIXED 3
+
+/*
+ * Background commands by pid.  The shell tells about starts on stderr and
+ * ends on stdout, which are read separately, so the end of a process may
+ * be read before its start.  Entries are not removed, a pid that comes
+ * again simply takes over its old entry.
+ */
+#define STARTED 1 /* when is the time the line was typed */
+#define ENDED   2 /* when is the time the end was read */
+
+static pid_t *key;
+static double *when;
+static char *state;
+static size_t mask;
+
+static double *lat; /* of the launches done */
+static double *queue; /* times lines were typed, not yet matched with a pid */
+static long done = 0, head = 0;
+static double fg_sent;
+static int running = 0, fg_pending = 0;
+
+/* slot:  entry of pid in the table, a free one if it is not there */
+static size_t slot(pid_t pid) {
+    size_t i;
+
+    for (i = (size_t) pid * 2654435761u & mask; key[i] != 0 && key[i] != pid; i = (i + 1) & mask)
+        ;
+    return i;
+}
+
+/* report:  take note of one line the shell wrote */
+static void report(char *line) {
+    double t = now();
+    pid_t pid;
+    size_t i;
+    char *p;
+
+    if ((p = strstr(line, "Spawned background")) != NULL &&
+            sscanf(p, "Spawned background process, pid: %d", &pid) == 1) {
+        i = slot(pid);
+        if (key[i] == pid && state[i] == ENDED) { /* its end came first */
+            lat[done++] = when[i] - queue[head++];
+            running--;
+            state[i] = 0;
+            return;
+        }
+        key[i] = pid;
+        when[i] = queue[head++];
+        state[i] = STARTED;
+    } else if ((p = strstr(line, "Background process")) != NULL &&
+            sscanf(p, "Background process with pid %d", &pid) == 1) {
+        i = slot(pid);
+        if (key[i] == pid && state[i] == STARTED) {
+            lat[done++] = t - when[i];
+            running--;
+            state[i] = 0;
+            return;
+        }
+        key[i] = pid;
+        when[i] = t;
+        state[i] = ENDED;
+    } else if (strstr(line, "Foreground process") != NULL && fg_pending) {
+        lat[done++] = t - fg_sent;
+        fg_pending = 0;
+    } else if (strstr(line, "exec failed") != NULL) {
+        fprintf(stderr, "launchbench: %s\n", line);
+        exit(1);
+    }
+}
+
+static void usage(char *progname) {
+
+    fprintf(stderr, "usage: %s [-s shell] [-a arg] [-m fg|bg|mixed] [-n launches] "
+            "[-w window] [-c command]\n", progname);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    char *shell = "./small_shell", *arg = NULL, *command = "/bin/true", *modename = "fg";
+    static struct stream out, err;
+    char cmd[4096];
+    double start, secs;
+    long n = 10000, sent = 0, tail = 0;
+    int mode = FG, window = 64;
+    int to, opt, bg, len;
+    struct pollfd pfd[2];
+    size_t size;
+    pid_t shell_pid;
+
+    while ((opt = getopt(argc, argv, "s:a:m:n:w:c:")) != -1) {
+        switch (opt) {
+            case 's':
+                shell = optarg;
+                break;
+            case 'a':
+                arg = optarg;
+                break;
+            case 'm':
+                modename = optarg;
+                if (strcmp(optarg, "fg") == 0)
+                    mode = FG;
+                else if (strcmp(optarg, "bg") == 0)
+                    mode = BG;
+                else if (strcmp(optarg, "mixed") == 0)
+                    mode = MIXED;
+                else
+                    usage(argv[0]);
+                break;
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'w':
+                window = atoi(optarg);
+                break;
+            case 'c':
+                command = optarg;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (n <= 0 || window <= 0)
+        usage(argv[0]);
+
+    for (size = 1024; size < 2 * (size_t) n; size *= 2)
+        ;
+    mask = size - 1;
+    key = calloc(size, sizeof (pid_t));
+    state = calloc(size, 1);
+    when = malloc(size * sizeof (double));
+    lat = malloc(n * sizeof (double));
+    queue = malloc(n * sizeof (double));
+    if (key == NULL || state == NULL || when == NULL || lat == NULL || queue == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    if ((shell_pid = start_shell(shell, arg, -1, &to, &out, &err)) < 0)
+        return 1;
+    signal(SIGPIPE, SIG_IGN);
+
+    start = now();
+    while (done < n) {
+        /* type as many lines as the mode allows */
+        while (sent < n && !fg_pending && running < window) {
+            bg = mode == BG || (mode == MIXED && sent % 2 == 1);
+            len = snprintf(cmd, sizeof (cmd), "%s%s\n", command, bg ? " &" : "");
+            if (bg) {
+                queue[tail++] = now();
+                running++;
+            } else {
+                fg_sent = now();
+                fg_pending = 1;
+            }
+            if (write(to, cmd, len) != len) { /* the shell may run it before this returns */
+                perror("write");
+                return 1;
+            }
+            sent++;
+        }
+
+        /* and read what the shell says about them */
+        pfd[0].fd = out.fd;
+        pfd[1].fd = err.fd;
+        pfd[0].events = pfd[1].events = POLLIN;
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return 1;
+        }
+        if ((pfd[1].revents && input(&err, report) < 0) || (pfd[0].revents && input(&out, report) < 0)) {
+            fprintf(stderr, "%s: shell ended after %ld of %ld launches\n", argv[0], done, n);
+            return 1;
+        }
+    }
+    secs = now() - start;
+
+    close(to);
+    while (read(out.fd, out.buf, sizeof (out.buf)) > 0)
+        ;
+    waitpid(shell_pid, NULL, 0);
+
+    qsort(lat, n, sizeof (double), cmp);
+    printf("%s %ld launches in %.3f s, %.0f launches/s\n", modename, n, secs, n / secs);
+    printf("latency ms: min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n",
+            lat[0] * 1e3, lat[n / 2] * 1e3, lat[n * 9 / 10] * 1e3,
+            lat[n * 99 / 100] * 1e3, lat[n - 1] * 1e3);
+    return 0;
+}
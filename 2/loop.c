@@ -11,12 +11,15 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <time.h>
 /*
- * 
+ * loop [ms]:  a short-lived command for launchbench, sleeps ms milliseconds
+ * (5 seconds if not given) and exits.
  */
 int main(int argc, char** argv) {
-    int i = 0;
-    sleep(5);
+    long ms = argc > 1 ? atol(argv[1]) : 5000;
+    struct timespec ts = { ms / 1000, ms % 1000 * 1000000 };
+    nanosleep(&ts, NULL);
     return (EXIT_SUCCESS);
 }
 
@@ -0,0 +1,85 @@
+/*
+ * shellpipe.c -- the shell on pipes for the benchmarks, see shellpipe.h
+ */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include "shellpipe.h"
+
+/*
+ * start_shell:  run shell -i arg, arg may be NULL.  Lines for it are
+ * written to *to, its stdout and stderr are read from out and err.  When
+ * fd3 is not -1 the shell, and every command it starts, finds it as
+ * descriptor 3.  Returns the pid of the shell, -1 after reporting an
+ * error.
+ */
+pid_t start_shell(char *shell, char *arg, int fd3, int *to, struct stream *out, struct stream *err) {
+    int in[2], o[2], e[2];
+    pid_t pid;
+
+    /* close-on-exec, only the dup2 copies reach the shell */
+    if (pipe2(in, O_CLOEXEC) < 0 || pipe2(o, O_CLOEXEC) < 0 || pipe2(e, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return -1;
+    }
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        dup2(in[0], STDIN_FILENO);
+        dup2(o[1], STDOUT_FILENO);
+        dup2(e[1], STDERR_FILENO);
+        if (fd3 == 3)
+            fcntl(3, F_SETFD, 0);
+        else if (fd3 >= 0)
+            dup2(fd3, 3);
+        execl(shell, shell, "-i", arg, (char *) NULL);
+        perror(shell);
+        _exit(127);
+    }
+    close(in[0]);
+    close(o[1]);
+    close(e[1]);
+    *to = in[1];
+    out->fd = o[0];
+    out->len = 0;
+    err->fd = e[0];
+    err->len = 0;
+    return pid;
+}
+
+/* input:  read what is there on s and hand its complete lines to report */
+int input(struct stream *s, void (*report)(char *)) {
+    char *line, *nl;
+    ssize_t got;
+
+    if ((got = read(s->fd, s->buf + s->len, sizeof (s->buf) - s->len - 1)) <= 0)
+        return -1;
+    s->len += got;
+    s->buf[s->len] = '\0';
+    for (line = s->buf; (nl = strchr(line, '\n')) != NULL; line = nl + 1) {
+        *nl = '\0';
+        report(line);
+    }
+    s->len -= line - s->buf; /* keep the start of a line not read completely */
+    memmove(s->buf, line, s->len);
+    return 0;
+}
+
+double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int cmp(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
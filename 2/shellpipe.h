@@ -0,0 +1,25 @@
+#ifndef _shellpipe_h_
+#define _shellpipe_h_
+
+#include <stddef.h>
+#include <sys/types.h>
+
+/*
+ * The shell on pipes, for launchbench and sigstorm.  It is run
+ * interactively with stdin, stdout and stderr each on a pipe of its own:
+ * the shell buffers stdout but not stderr, on one pipe their lines would
+ * get mixed up.  What it writes is read a stream at a time and handed on
+ * a complete line at a time.
+ */
+struct stream {
+    int fd;
+    size_t len;
+    char buf[65536];
+};
+
+extern pid_t start_shell(char *, char *, int, int *, struct stream *, struct stream *);
+extern int input(struct stream *, void (*)(char *));
+extern double now(void);
+extern int cmp(const void *, const void *);
+
+#endif
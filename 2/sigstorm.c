@@ -0,0 +1,327 @@
+/*
+ *
+ * NAME:
+ *   sigstorm  -  stress the reaping of background jobs in small_shell
+ *
+ * SYNTAX:
+ *   sigstorm [-s shell] [-a arg] [-n jobs] [-p part] [-k signals]
+ *            [-d ms] [-r ms] [-t seconds]
+ *
+ * DESCRIPTION:
+ *   sigstorm runs the shell interactively on pipes and starts jobs
+ *   background jobs in it at once, all of them copies of sigstorm itself
+ *   that live a few milliseconds.  Part of them first send spurious
+ *   SIGCHLD signals to the shell, like 3/tstSig.c does.  Just before it
+ *   exits every job writes its pid and the time to a pipe of its own.
+ *   Meanwhile sigstorm keeps typing "echo" at the shell to see how fast it
+ *   answers.
+ *
+ *   At the end it checks that every job was reported as terminated
+ *   exactly once and prints the latency from the exit of a job to its
+ *   report, and the time the shell took to answer the echo lines.  The
+ *   exit status is 1 if a job was lost or reported twice.
+ *
+ * OPTIONS:
+ *   -s shell      the shell to run (default ./small_shell), it is given -i
+ *   -a arg        one more argument for the shell, e.g. -z
+ *   -n jobs       background jobs to start (default 500)
+ *   -p part       part of the jobs that send spurious SIGCHLD (default 0.5)
+ *   -k signals    spurious SIGCHLD sent by such a job (default 10)
+ *   -d ms         jobs live up to this long (default 100)
+ *   -r ms         type an echo line this often (default 10)
+ *   -t seconds    give up after this long (default 60)
+ *
+ * EXAMPLES:
+ *   sigstorm -n 2000 -p 1 -k 50
+ *   sigstorm -a -z
+ *
+ */
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "shellpipe.h"
+
+/* What a job writes to the report pipe just before it exits. */
+struct exited {
+    pid_t pid;
+    double when;
+};
+
+/*
+ * The jobs by pid.  The shell tells about their start on stderr and their
+ * end on stdout, the jobs about their exit on the report pipe, each may
+ * come first.
+ */
+struct jobstate {
+    pid_t pid;
+    int spawned; /* times the shell said it started */
+    int reported; /* times the shell said it terminated */
+    double exited; /* when it exited, 0 if not known yet */
+    double reaped; /* when the shell reported it */
+};
+
+static struct jobstate *tab;
+static size_t mask;
+
+static long spawned = 0, reported = 0, unknown = 0;
+static long ping_sent = 0, ping_seen = 0;
+static double ping_time;
+static double *reap_lat, *ping_lat;
+static long nreap = 0, nping = 0;
+
+/* child:  a job, send signals SIGCHLD to the shell, live ms and report */
+static int child(int signals, int ms, int fd) {
+    struct timespec ts = { 0, 100000 };
+    struct exited e;
+    int i;
+
+    for (i = 0; i < signals; i++) {
+        kill(getppid(), SIGCHLD);
+        nanosleep(&ts, NULL);
+    }
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = ms % 1000 * 1000000L;
+    nanosleep(&ts, NULL);
+    e.pid = getpid();
+    e.when = now();
+    write(fd, &e, sizeof (e));
+    return 0;
+}
+
+/* lookup:  entry of pid in the table, a new one if it is not there */
+static struct jobstate *lookup(pid_t pid) {
+    size_t i;
+
+    for (i = (size_t) pid * 2654435761u & mask; tab[i].pid != 0 && tab[i].pid != pid; i = (i + 1) & mask)
+        ;
+    tab[i].pid = pid;
+    return &tab[i];
+}
+
+/* reap_done:  js was reported and has exited, take its latency */
+static void reap_done(struct jobstate *js) {
+
+    if (js->reported == 1 && js->exited > 0)
+        reap_lat[nreap++] = js->reaped - js->exited;
+}
+
+/* report:  take note of one line the shell wrote */
+static void report(char *line) {
+    struct jobstate *js;
+    char *p;
+    pid_t pid;
+    long n;
+
+    if ((p = strstr(line, "Spawned background")) != NULL &&
+            sscanf(p, "Spawned background process, pid: %d", &pid) == 1) {
+        lookup(pid)->spawned++;
+        spawned++;
+    } else if ((p = strstr(line, "Background process")) != NULL &&
+            sscanf(p, "Background process with pid %d", &pid) == 1) {
+        js = lookup(pid);
+        if (++js->reported == 1) {
+            js->reaped = now();
+            reported++;
+            reap_done(js);
+        } else
+            fprintf(stderr, "sigstorm: pid %d reported %d times\n", pid, js->reported);
+    } else if ((p = strstr(line, "ping ")) != NULL && sscanf(p, "ping %ld", &n) == 1 &&
+            n == ping_sent) {
+        ping_lat[nping++] = now() - ping_time;
+        ping_seen = n;
+    } else if (strstr(line, "exec failed") != NULL) {
+        fprintf(stderr, "sigstorm: %s\n", line);
+        exit(1);
+    }
+}
+
+/* pr_dist:  the distribution of the n latencies in lat */
+static void pr_dist(const char *what, double *lat, long n) {
+
+    if (n == 0) {
+        printf("%s: none\n", what);
+        return;
+    }
+    qsort(lat, n, sizeof (double), cmp);
+    printf("%s ms: min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f\n", what,
+            lat[0] * 1e3, lat[n / 2] * 1e3, lat[n * 9 / 10] * 1e3,
+            lat[n * 99 / 100] * 1e3, lat[n - 1] * 1e3);
+}
+
+static void usage(char *progname) {
+
+    fprintf(stderr, "usage: %s [-s shell] [-a arg] [-n jobs] [-p part] [-k signals] "
+            "[-d ms] [-r ms] [-t seconds]\n", progname);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    char *shell = "./small_shell", *arg = NULL, *self;
+    static struct stream out, err;
+    char *cmd = NULL;
+    size_t size, cmdlen = 0, cmdoff = 0;
+    double part = 0.5, start, next_ping, limit = 60;
+    long n = 500, i, lost = 0, twice = 0;
+    int signals = 10, ms = 100, every = 10, opt, len, timeout;
+    int to, rep[2];
+    struct pollfd pfd[4];
+    struct exited e;
+    struct jobstate *js;
+    pid_t shell_pid;
+
+    /* a job started by the shell */
+    if (argc == 5 && strcmp(argv[1], "-C") == 0)
+        return child(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+
+    while ((opt = getopt(argc, argv, "s:a:n:p:k:d:r:t:")) != -1) {
+        switch (opt) {
+            case 's':
+                shell = optarg;
+                break;
+            case 'a':
+                arg = optarg;
+                break;
+            case 'n':
+                n = atol(optarg);
+                break;
+            case 'p':
+                part = atof(optarg);
+                break;
+            case 'k':
+                signals = atoi(optarg);
+                break;
+            case 'd':
+                ms = atoi(optarg);
+                break;
+            case 'r':
+                every = atoi(optarg);
+                break;
+            case 't':
+                limit = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (n <= 0 || part < 0 || part > 1 || signals < 0 || ms <= 0 || every <= 0)
+        usage(argv[0]);
+
+    for (size = 1024; size < 2 * (size_t) n; size *= 2)
+        ;
+    mask = size - 1;
+    tab = calloc(size, sizeof (*tab));
+    reap_lat = malloc(n * sizeof (double));
+    ping_lat = malloc((size_t) (limit * 1000 / every + 2) * sizeof (double));
+    if ((self = realpath("/proc/self/exe", NULL)) == NULL)
+        self = argv[0];
+    if (tab == NULL || reap_lat == NULL || ping_lat == NULL) {
+        perror("malloc");
+        return 1;
+    }
+
+    /* the lines for all jobs, typed as fast as the shell reads them */
+    for (i = 0; i < n; i++) {
+        len = snprintf(NULL, 0, "%s -C %d %ld 3 &\n", self,
+                i < n * part ? signals : 0, 1 + i % ms);
+        if ((cmd = realloc(cmd, cmdlen + len + 1)) == NULL) {
+            perror("malloc");
+            return 1;
+        }
+        cmdlen += sprintf(cmd + cmdlen, "%s -C %d %ld 3 &\n", self,
+                i < n * part ? signals : 0, 1 + i % ms);
+    }
+
+    if (pipe2(rep, O_CLOEXEC) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    /* the jobs find the report pipe as descriptor 3 */
+    if ((shell_pid = start_shell(shell, arg, rep[1], &to, &out, &err)) < 0)
+        return 1;
+    close(rep[1]);
+    fcntl(to, F_SETFL, O_NONBLOCK);
+    fcntl(rep[0], F_SETFL, O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    start = next_ping = now();
+    while (reported < n || nreap < n) {
+        if (now() - start > limit) {
+            fprintf(stderr, "sigstorm: gave up after %.0f s\n", limit);
+            break;
+        }
+        /* an echo line, once the last one was answered */
+        if (ping_seen == ping_sent && now() >= next_ping && cmdoff == cmdlen) {
+            ping_sent++;
+            len = snprintf(NULL, 0, "echo ping %ld\n", ping_sent);
+            if ((cmd = realloc(cmd, cmdlen + len + 1)) == NULL) {
+                perror("malloc");
+                return 1;
+            }
+            cmdlen += sprintf(cmd + cmdlen, "echo ping %ld\n", ping_sent);
+            ping_time = now();
+            next_ping = ping_time + every / 1e3;
+        }
+
+        pfd[0].fd = out.fd;
+        pfd[1].fd = err.fd;
+        pfd[2].fd = rep[0];
+        pfd[0].events = pfd[1].events = pfd[2].events = POLLIN;
+        pfd[3].fd = cmdoff < cmdlen ? to : -1;
+        pfd[3].events = POLLOUT;
+        timeout = (next_ping - now()) * 1e3 + 1;
+        if (poll(pfd, 4, timeout < 1 ? 1 : timeout) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return 1;
+        }
+        if (pfd[3].revents & POLLOUT) {
+            if ((len = write(to, cmd + cmdoff, cmdlen - cmdoff)) > 0)
+                cmdoff += len;
+        }
+        if (pfd[2].revents & POLLIN) {
+            while (read(rep[0], &e, sizeof (e)) == sizeof (e)) {
+                js = lookup(e.pid);
+                js->exited = e.when;
+                reap_done(js);
+            }
+        }
+        if ((pfd[1].revents && input(&err, report) < 0) || (pfd[0].revents && input(&out, report) < 0)) {
+            fprintf(stderr, "sigstorm: shell ended\n");
+            break;
+        }
+    }
+
+    close(to);
+    while (read(out.fd, out.buf, sizeof (out.buf)) > 0)
+        ;
+    waitpid(shell_pid, NULL, 0);
+
+    for (i = 0; i <= (long) mask; i++) {
+        if (tab[i].pid == 0)
+            continue;
+        if (tab[i].spawned == 0)
+            unknown++;
+        else if (tab[i].reported == 0)
+            lost++;
+        else if (tab[i].reported > 1)
+            twice++;
+    }
+    printf("%ld jobs, %ld sending %d spurious SIGCHLD each: %ld spawned, %ld reaped, "
+            "%ld lost, %ld reported twice, %ld unknown\n", n, (long) (n * part + 0.999),
+            signals, spawned, reported, lost, twice, unknown);
+    pr_dist("exit to report", reap_lat, nreap);
+    pr_dist("echo answered", ping_lat, nping);
+    return spawned == n && reported == n && nreap == n && lost == 0 && twice == 0 &&
+            unknown == 0 ? 0 : 1;
+}
@@ -1,8 +1,16 @@
-/* 
+/*
  * File:   small_shell.c
  * Author: alsod
  *
  * Created on November 24, 2009, 7:55 PM
+ *
+ * usage: small_shell [-iz] [-f file] [-j jobs]
+ *
+ * Reads commands from the terminal, or runs the lines of file (or of stdin
+ * when it is not a terminal) as a batch: quietly, with at most jobs lines
+ * running at a time, and exits 1 if any of them failed.  -i makes the
+ * shell interactive even when stdin is not a terminal.  -z starts the
+ * commands from a zygote process forked at startup.
  */
 #define _XOPEN_SOURCE 500
 #define _GNU_SOURCE
@@ -13,16 +21,166 @@
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdarg.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <sched.h>
+#include <spawn.h>
 #include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/signalfd.h>
+#include <time.h>
+#ifdef KR_MALLOC
+#include "malloc.h"
+#endif
+
+#define MAXSTAGES 16 /* commands in one pipeline */
+#define NHASH     64 /* buckets of the command path table */
+#define NPROCHASH 1024 /* buckets of the table of followed processes */
+#define CHUNK     4096 /* smallest piece the line arena grows by */
+#define NLIMITS   4 /* resource limits a command can be given */
+#define NOEXEC    W_EXITCODE(127, 0) /* status of a command that could not be started */
+#define MAXWALL   (INT_MAX / 1000 - 1) /* seconds, so the milliseconds left fit an int */
+
+/*
+ * Limits for the commands started.  The resource limits are set in the
+ * child before the exec, the wall-clock limit is kept by the shell, which
+ * kills the job when it runs out.
+ */
+struct limits {
+    rlim_t value[NLIMITS]; /* for setrlimit, RLIM_INFINITY if none */
+    double wall; /* seconds, 0 if none */
+};
+
+static const struct {
+    const char *name;
+    int resource;
+    rlim_t unit; /* of the value given to limit */
+} limit_names[NLIMITS] = {
+    { "cpu", RLIMIT_CPU, 1 }, /* seconds */
+    { "mem", RLIMIT_AS, 1 << 20 }, /* MiB of address space */
+    { "files", RLIMIT_NOFILE, 1 }, /* open files */
+    { "procs", RLIMIT_NPROC, 1 }, /* processes of the user */
+};
+
+static struct limits shell_limits; /* set by the limit builtin */
+
+/*
+ * A command line: one or more commands joined by '|', the first one may
+ * read from a file ("< file") and the last one may write to one ("> file"
+ * or ">> file").  The argument vectors of all stages are kept in words,
+ * each ending with a NULL.  Words and their text live in the line arena.
+ */
+struct cmdline {
+    char **words;
+    char **stage[MAXSTAGES]; /* argument vector of each command */
+    int nstages;
+    char *in, *out; /* redirections, NULL if none */
+    int append; /* >> rather than > */
+    int background; /* ended with & */
+    int timed; /* started with time */
+    struct limits lim;
+};
+
+/*
+ * The line arena.  Everything made while parsing a command line comes
+ * from here and is handed back all at once by arena_reset() before the
+ * next line is read.  Chunks of CHUNK bytes are kept for reuse, so once
+ * the arena has grown to fit the usual line, reading and parsing a line
+ * does no malloc or free at all.  Bigger chunks, made for an unusually
+ * long line, are freed again, the arena does not stay at the size of the
+ * longest line ever seen.  Built on the project's malloc (KR_MALLOC) they
+ * are allocated as short-lived, apart from the jobs and the path table.
+ */
+struct chunk {
+    struct chunk *next;
+    size_t size, used;
+    char mem[];
+};
+
+static struct chunk *arena = NULL, *arena_cur = NULL;
+
+/*
+ * Background jobs.  The processes of a background pipeline are reported
+ * together, once the last of them has been reaped, with the resources all
+ * of them used.  Every followed process is found by its pid in proctab, so
+ * reaping costs the same however many jobs are running.  Jobs and process
+ * entries that are done go to free lists and are used again.
+ */
+struct job {
+    pid_t pid[MAXSTAGES]; /* 0 once reaped */
+    int n; /* processes in the job */
+    int left; /* not yet reaped */
+    pid_t last; /* pid of the last process */
+    int lost; /* the last command was not started */
+    int status; /* of the last process, NOEXEC if lost */
+    int line; /* of the batch it came from */
+    int timed;
+    int limited; /* started with limits */
+    double wall; /* wall-clock limit, 0 if none */
+    int killed; /* because wall ran out */
+    struct timespec start;
+    struct timespec deadline; /* start + wall */
+    struct rusage ru; /* of the processes reaped so far */
+    struct job *next; /* in the free list */
+    struct job *dnext; /* in the deadline list */
+};
+
+struct proc {
+    pid_t pid;
+    struct job *job;
+    struct proc *next;
+};
+
+static struct proc *proctab[NPROCHASH];
+static struct proc *free_procs = NULL;
+static struct job *free_jobs = NULL;
+static struct job *deadlines = NULL; /* jobs with a wall-clock limit */
+static int njobs = 0; /* jobs running */
+
+/*
+ * Batch mode.  Every line becomes a job that is followed like a background
+ * job, without announcements, and the shell goes on with the next line as
+ * long as fewer than maxjobs are running.  Builtins wait for all of them.
+ */
+static int interactive = 1;
+static int maxjobs = 1;
+static int lineno = 0; /* lines read in batch mode */
+static int started = 0, failed = 0; /* jobs in batch mode */
+
+/*
+ * Command paths.  A command name without a '/' is looked up in PATH once
+ * and its absolute path is remembered, so later launches exec it directly
+ * instead of trying execve in one PATH directory after the other.  The
+ * table is emptied by "hash -r" and whenever PATH has changed.
+ */
+struct cmdpath {
+    char *name;
+    char *path;
+    int hits; /* launches through this entry */
+    struct cmdpath *next;
+};
+
+static struct cmdpath *pathtab[NHASH];
+static char *hashed_path = NULL; /* value of PATH the table is for */
 
 /**
- *
+ * pr_exit:  how a job ended.  wall is its wall-clock limit if the shell
+ * killed it for running out of it, 0 otherwise.
  */
-void pr_exit(int status) {
-    if (WIFEXITED(status))
+void pr_exit(int status, double wall) {
+    if (wall > 0)
+        printf("Process killed, wall-clock limit of %g s exceeded\n", wall);
+    else if (WIFSIGNALED(status) && (WTERMSIG(status) == SIGXCPU || WTERMSIG(status) == SIGXFSZ))
+        printf("Process terminated, %s\n", strsignal(WTERMSIG(status))); /* a limit ran out */
+    else if (WIFEXITED(status))
         printf("Process terminated normally, exit status = %d\n", WEXITSTATUS(status));
     else if (WIFSIGNALED(status))
         printf("Process terminated abnormally, signal number = %d, %s\n", WTERMSIG(status), strsignal(WTERMSIG(status)));
@@ -31,147 +189,1649 @@ void pr_exit(int status) {
 
 }
 
-/* SIGCHLD handler. */
-static void sigchld_hdl(int sig) {
+/* elapsed:  seconds since start on the monotonic clock */
+static double elapsed(const struct timespec *start) {
 
-    pid_t pid;
-    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
-        printf("\nBackground process with pid %d terminated.\n", pid);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* ru_add:  add the usage of one more process of a job to sum */
+static void ru_add(struct rusage *sum, const struct rusage *ru) {
+
+    timeradd(&sum->ru_utime, &ru->ru_utime, &sum->ru_utime);
+    timeradd(&sum->ru_stime, &ru->ru_stime, &sum->ru_stime);
+    if (ru->ru_maxrss > sum->ru_maxrss) /* the processes of a pipeline run side by side */
+        sum->ru_maxrss = ru->ru_maxrss;
+    sum->ru_nvcsw += ru->ru_nvcsw;
+    sum->ru_nivcsw += ru->ru_nivcsw;
+}
+
+/* ru_since:  make the usage of the shell in ru the part since before */
+static void ru_since(struct rusage *ru, const struct rusage *before) {
+
+    timersub(&ru->ru_utime, &before->ru_utime, &ru->ru_utime);
+    timersub(&ru->ru_stime, &before->ru_stime, &ru->ru_stime);
+    ru->ru_nvcsw -= before->ru_nvcsw;
+    ru->ru_nivcsw -= before->ru_nivcsw;
+}
+
+/*
+ * pr_usage:  report the run time and resource usage of a job, and for a
+ * job started with time also in the format of time -p.
+ */
+static void pr_usage(FILE *fp, double real, const struct rusage *ru, int timed) {
+
+    fprintf(fp, "Runtime: %d s %.*f ms\n", (int) real, 3, (real - (int) real) * 1000);
+    fprintf(fp, "CPU: user %ld.%03ld s, sys %ld.%03ld s, max RSS %ld kB, context switches: %ld voluntary, %ld involuntary\n",
+            (long) ru->ru_utime.tv_sec, (long) ru->ru_utime.tv_usec / 1000,
+            (long) ru->ru_stime.tv_sec, (long) ru->ru_stime.tv_usec / 1000,
+            ru->ru_maxrss, ru->ru_nvcsw, ru->ru_nivcsw);
+    if (timed)
+        fprintf(fp, "real %.3f\nuser %.3f\nsys %.3f\n", real,
+                ru->ru_utime.tv_sec + ru->ru_utime.tv_usec / 1e6,
+                ru->ru_stime.tv_sec + ru->ru_stime.tv_usec / 1e6);
+}
+
+/* batch_report:  the end of job jp in batch mode, only failures are told */
+static void batch_report(struct job *jp) {
+
+    if (jp->status != 0) {
+        failed++;
+        if (jp->killed)
+            fprintf(stderr, "line %d: killed, wall-clock limit of %g s exceeded\n",
+                    jp->line, jp->wall);
+        else if (WIFSIGNALED(jp->status))
+            fprintf(stderr, "line %d: killed by signal %d, %s\n", jp->line,
+                    WTERMSIG(jp->status), strsignal(WTERMSIG(jp->status)));
+        else
+            fprintf(stderr, "line %d: exit status %d\n", jp->line, WEXITSTATUS(jp->status));
     }
+    if (jp->timed)
+        pr_usage(stderr, elapsed(&jp->start), &jp->ru, 1);
+}
+
+/* set_deadline:  kill job jp once it has run for wall seconds */
+static void set_deadline(struct job *jp, double wall) {
+
+    long ns = jp->start.tv_nsec + (long) ((wall - (long) wall) * 1e9);
 
+    jp->wall = wall;
+    jp->killed = 0;
+    if (wall <= 0)
+        return;
+    jp->deadline.tv_sec = jp->start.tv_sec + (long) wall + ns / 1000000000;
+    jp->deadline.tv_nsec = ns % 1000000000;
+    jp->dnext = deadlines;
+    deadlines = jp;
 }
 
+/* drop_deadline:  jp is done, it needs no killing */
+static void drop_deadline(struct job *jp) {
+
+    struct job **jpp;
+    for (jpp = &deadlines; *jpp != NULL; jpp = &(*jpp)->dnext)
+        if (*jpp == jp) {
+            *jpp = jp->dnext;
+            return;
+        }
+}
 
 /*
- * 
+ * expire:  kill the jobs whose wall-clock limit has run out.  Returns
+ * the milliseconds until the next limit runs out, -1 if there is none.
  */
-int main(int argc, char** argv) {
+static int expire(void) {
 
-    /* signaling*/
-    struct sigaction act;
-    memset(&act, 0, sizeof (act));
-    act.sa_handler = sigchld_hdl;
+    struct job **jpp, *jp;
+    struct timespec now;
+    long ms, next = -1;
+    int i;
 
-    if (sigaction(SIGCHLD, &act, 0)) {
-        perror("sigaction");
-        return 1;
+    if (deadlines == NULL)
+        return -1;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (jpp = &deadlines; (jp = *jpp) != NULL; ) {
+        ms = (jp->deadline.tv_sec - now.tv_sec) * 1000 +
+                (jp->deadline.tv_nsec - now.tv_nsec + 999999) / 1000000;
+        if (ms > 0) {
+            if (next < 0 || ms < next)
+                next = ms;
+            jpp = &jp->dnext;
+            continue;
+        }
+        for (i = 0; i < jp->n; i++)
+            if (jp->pid[i] != 0)
+                kill(jp->pid[i], SIGKILL);
+        jp->killed = 1;
+        *jpp = jp->dnext;
+    }
+    return next > INT_MAX ? INT_MAX : (int) next;
+}
+
+/*
+ * wait_child:  wait4(-1, ...) that kills the jobs out of time meanwhile.
+ * SIGCHLD is blocked, so it is waited for with sigtimedwait until the
+ * next limit runs out.
+ */
+static pid_t wait_child(int *status, struct rusage *ru) {
+
+    struct timespec ts;
+    sigset_t chld;
+    pid_t pid;
+    int ms;
+
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    for (;;) {
+        if ((ms = expire()) < 0)
+            return wait4(-1, status, 0, ru);
+        if ((pid = wait4(-1, status, WNOHANG, ru)) != 0)
+            return pid;
+        ts.tv_sec = ms / 1000;
+        ts.tv_nsec = ms % 1000 * 1000000L;
+        sigtimedwait(&chld, NULL, &ts);
+    }
+}
+
+/* reaped:  account followed process pid, report its job once all are gone */
+static void reaped(pid_t pid, int status, const struct rusage *ru) {
+
+    struct proc **pp, *p;
+    struct job *jp;
+    int i;
+
+    for (pp = &proctab[pid % NPROCHASH]; (p = *pp) != NULL; pp = &p->next)
+        if (p->pid == pid)
+            break;
+    if (p == NULL) {
+        if (interactive)
+            printf("\nBackground process with pid %d terminated.\n", pid); /* not followed */
+        return;
+    }
+    *pp = p->next;
+    p->next = free_procs;
+    free_procs = p;
+
+    jp = p->job;
+    for (i = 0; i < jp->n; i++)
+        if (jp->pid[i] == pid)
+            jp->pid[i] = 0;
+    ru_add(&jp->ru, ru);
+    if (pid == jp->last && !jp->lost)
+        jp->status = status;
+    if (--jp->left > 0)
+        return;
+    njobs--;
+    drop_deadline(jp);
+    if (!interactive)
+        batch_report(jp);
+    else {
+        if (jp->n == 1)
+            printf("\nBackground process with pid %d terminated.\n", pid);
+        else
+            printf("\nBackground pipeline of %d processes, last pid %d, terminated.\n",
+                    jp->n, jp->last);
+        pr_usage(stdout, elapsed(&jp->start), &jp->ru, jp->timed);
+        if (jp->limited)
+            pr_exit(jp->status, jp->killed ? jp->wall : 0);
+    }
+    jp->next = free_jobs;
+    free_jobs = jp;
+}
+
+/*
+ * reap:  reap every child that has ended, without waiting.  One SIGCHLD
+ * may stand for many children, so the loop goes on until none is left.
+ * Returns the number reaped.
+ */
+static int reap(void) {
+
+    struct rusage ru;
+    pid_t pid;
+    int status, n = 0;
+    while ((pid = wait4(-1, &status, WNOHANG, &ru)) > 0) {
+        reaped(pid, status, &ru);
+        n++;
     }
+    return n;
+}
+
+/* wait_any:  reap one child, returns -1 if there is none */
+static int wait_any(void) {
 
-    /* process */
+    struct rusage ru;
     pid_t pid;
     int status;
+    while ((pid = wait_child(&status, &ru)) < 0)
+        if (errno != EINTR)
+            return -1;
+    reaped(pid, status, &ru);
+    return 0;
+}
 
-    /* process timing */
-    struct timeval start_time;
-    struct timeval end_time;
-    int runtime_s;
-    double runtime_ms;
+/* drain:  in batch mode, wait for every job still running */
+static void drain(void) {
 
-    /* command parsing */
-    char command[500];
-    char *params[6];
+    while (!interactive && njobs > 0 && wait_any() == 0)
+        ;
+}
 
-    char *home = getenv("HOME");
-    int background = 0;
+/* hash:  bucket of command name s */
+static unsigned hash(const char *s) {
 
+    unsigned h = 0;
+    while (*s != '\0')
+        h = h * 31 + (unsigned char) *s++;
+    return h % NHASH;
+}
 
+/* path_flush:  forget all command paths */
+static void path_flush(void) {
 
+    struct cmdpath *cp, *next;
+    int i;
+    for (i = 0; i < NHASH; i++) {
+        for (cp = pathtab[i]; cp != NULL; cp = next) {
+            next = cp->next;
+            free(cp->name);
+            free(cp->path);
+            free(cp);
+        }
+        pathtab[i] = NULL;
+    }
+}
 
-    while (1) {
+/* path_forget:  drop the remembered path of command name */
+static void path_forget(const char *name) {
 
-        if (background != 1) /* will duplicate prompt otherwise */
-            printf("prompt: ");
+    struct cmdpath **cpp, *cp;
+    for (cpp = &pathtab[hash(name)]; (cp = *cpp) != NULL; cpp = &cp->next)
+        if (strcmp(cp->name, name) == 0) {
+            *cpp = cp->next;
+            free(cp->name);
+            free(cp->path);
+            free(cp);
+            return;
+        }
+}
+
+/* path_search:  first executable file name in the directories of PATH */
+static char *path_search(const char *name, char *buf, size_t size) {
+
+    const char *dir, *end, *path = getenv("PATH");
+    struct stat st;
+    int len;
+
+    if (path == NULL)
+        path = "/bin:/usr/bin";
+    for (dir = path; ; dir = end + 1) {
+        if ((end = strchr(dir, ':')) == NULL)
+            end = dir + strlen(dir);
+        if (end == dir) /* empty entry is the current directory */
+            len = snprintf(buf, size, "%s", name);
+        else
+            len = snprintf(buf, size, "%.*s/%s", (int) (end - dir), dir, name);
+        if (len < (int) size && stat(buf, &st) == 0 && S_ISREG(st.st_mode) &&
+                access(buf, X_OK) == 0)
+            return buf;
+        if (*end == '\0')
+            return NULL;
+    }
+}
+
+/*
+ * path_lookup:  the file to exec for command name, NULL if there is none.
+ * Paths found through a relative PATH entry depend on the current
+ * directory and are not remembered.
+ */
+static struct cmdpath *path_lookup(const char *name) {
+
+    static struct cmdpath uncached;
+    static char buf[4096];
+    struct cmdpath *cp;
+    const char *path = getenv("PATH");
+    unsigned h;
 
-        background = 0; /* reset to default process mode*/
+    uncached.name = uncached.path = (char *) name;
+    if (strchr(name, '/') != NULL)
+        return &uncached;
 
+    if (path == NULL)
+        path = "";
+    if (hashed_path == NULL || strcmp(hashed_path, path) != 0) { /* PATH changed */
+        path_flush();
+        free(hashed_path);
+        hashed_path = strdup(path);
+    }
 
-        while(fgets(command, 499, stdin) == NULL) { /* restart if fgets get interupted.*/
-            printf("promptb: ");
+    h = hash(name);
+    for (cp = pathtab[h]; cp != NULL; cp = cp->next)
+        if (strcmp(cp->name, name) == 0)
+            return cp;
+
+    if (path_search(name, buf, sizeof (buf)) == NULL)
+        return NULL;
+    if (buf[0] != '/' || (cp = malloc(sizeof (*cp))) == NULL) {
+        uncached.path = buf;
+        return &uncached;
+    }
+    cp->name = strdup(name);
+    cp->path = strdup(buf);
+    cp->hits = 0;
+    cp->next = pathtab[h];
+    pathtab[h] = cp;
+    return cp;
+}
+
+/* hash_cmd:  the hash builtin, "hash" lists, "hash -r" empties the table */
+static int hash_cmd(char **params) {
+
+    struct cmdpath *cp;
+    int i, status = 0;
+
+    if (params[1] == NULL) {
+        printf("hits\tcommand\n");
+        for (i = 0; i < NHASH; i++)
+            for (cp = pathtab[i]; cp != NULL; cp = cp->next)
+                printf("%4d\t%s\n", cp->hits, cp->path);
+    } else if (strcmp(params[1], "-r") == 0) {
+        path_flush();
+    } else {
+        for (i = 1; params[i] != NULL; i++)
+            if (strchr(params[i], '/') == NULL && path_lookup(params[i]) == NULL) {
+                fprintf(stderr, "hash: %s: not found\n", params[i]);
+                status = 1;
+            }
+    }
+    return status;
+}
+
+/* arena_alloc:  n bytes from the line arena, NULL if out of memory */
+static void *arena_alloc(size_t n) {
+
+    struct chunk *cp, **cpp;
+
+    n = (n + 15) & ~(size_t) 15;
+    if (n > CHUNK) { /* a chunk of its own, in front where it is not searched */
+#ifdef KR_MALLOC
+        cp = malloc_hint(sizeof (*cp) + n, MALLOC_SHORT_LIVED);
+#else
+        cp = malloc(sizeof (*cp) + n);
+#endif
+        if (cp == NULL)
+            return NULL;
+        cp->next = arena;
+        cp->size = cp->used = n;
+        arena = cp;
+        return cp->mem;
+    }
+    for (cp = arena_cur; cp != NULL; cp = cp->next)
+        if (cp->size - cp->used >= n)
+            break;
+    if (cp == NULL) {
+        if ((cp = malloc(sizeof (*cp) + CHUNK)) == NULL)
+            return NULL;
+        cp->next = NULL;
+        cp->size = CHUNK;
+        cp->used = 0;
+        for (cpp = &arena; *cpp != NULL; cpp = &(*cpp)->next)
+            ;
+        *cpp = cp;
+    }
+    arena_cur = cp;
+    cp->used += n;
+    return cp->mem + cp->used - n;
+}
+
+/* arena_reset:  give back everything taken from the line arena */
+static void arena_reset(void) {
+
+    struct chunk *cp, **cpp;
+    for (cpp = &arena; (cp = *cpp) != NULL; )
+        if (cp->size > CHUNK) { /* for one long line only */
+            *cpp = cp->next;
+            free(cp);
+        } else {
+            cp->used = 0;
+            cpp = &cp->next;
         }
+    arena_cur = arena;
+}
 
-        strtok(command, "\n"); /* strip away the newline character*/
+/* syntax_error:  report a malformed line, in batch mode with its number */
+static void syntax_error(const char *fmt, ...) {
 
-        /*-------------- Start of argument parsing -----------------------*/
+    va_list ap;
+    if (!interactive)
+        fprintf(stderr, "line %d: ", lineno);
+    va_start(ap, fmt);
+    vfprintf(stderr, fmt, ap);
+    va_end(ap);
+}
+
+/* add_word:  append word to the words of cl, which hold *max at most */
+static int add_word(struct cmdline *cl, int *n, int *max, char *word) {
+
+    char **words;
+
+    if (*n == *max) { /* move to a vector twice the size, the old one stays in the arena */
+        if ((words = arena_alloc((2 * *max + 1) * sizeof (char *))) == NULL)
+            return -1;
+        memcpy(words, cl->words, *n * sizeof (char *));
+        cl->words = words;
+        *max *= 2;
+    }
+    cl->words[(*n)++] = word;
+    return 0;
+}
 
-        char *token;
-        token = strtok(command, " "); /* get first token */
+/*
+ * parse:  split line into the commands and redirections of cl, in one pass
+ * over the line.  Words are separated by blanks and by the operators |, <,
+ * >, >> and &, which need no blanks around them.  In a word '...' quotes
+ * every character, "..." every character but \", \\, \$ and \`, and a
+ * backslash the character after it.  An unquoted # starts a comment.  The
+ * words are copied to the line arena, unquoted, so the text written never
+ * exceeds twice the length of the line.  Returns 0, with cl->nstages 0 for
+ * an empty line, or -1 after reporting a syntax error.
+ */
+static int parse(char *line, struct cmdline *cl) {
 
-        int i = 0;
-        while (token != NULL) {
-            params[i] = token;
-            token = strtok(NULL, " "); /* get tokens until no more is found*/
-            i++;
+    char *r = line, *w, *word, **target = NULL;
+    int starts[MAXSTAGES]; /* first word of each command */
+    int n = 0, max = 16, i;
+
+    memset(cl, 0, sizeof (*cl));
+    w = arena_alloc(2 * strlen(line) + 1);
+    cl->words = arena_alloc((max + 1) * sizeof (char *));
+    if (w == NULL || cl->words == NULL) {
+        syntax_error("out of memory\n");
+        return -1;
+    }
+    starts[0] = 0;
+
+    for (;;) {
+        while (*r == ' ' || *r == '\t' || *r == '\n')
+            r++;
+        if (*r == '\0' || *r == '#')
+            break;
+        if (cl->background) {
+            syntax_error("syntax error: & must end the line\n");
+            return -1;
         }
 
-        i = i - 1;
-        if (i > 0) {
-            /* Check for & */
-            if (strcmp(params[i], "&") == 0) {
-                background = 1;
+        if (strchr("|<>&", *r) != NULL) { /* an operator */
+            if (target != NULL) {
+                syntax_error("syntax error: no file after %s\n", target == &cl->in ? "<" : ">");
+                return -1;
+            }
+            switch (*r++) {
+                case '&':
+                    cl->background = 1;
+                    break;
+                case '<':
+                    if (cl->nstages > 0) {
+                        syntax_error("syntax error: < file only for the first command\n");
+                        return -1;
+                    }
+                    target = &cl->in;
+                    break;
+                case '>':
+                    if ((cl->append = *r == '>'))
+                        r++;
+                    target = &cl->out;
+                    break;
+                case '|':
+                    if (n == starts[cl->nstages] || cl->out != NULL || cl->nstages + 1 >= MAXSTAGES) {
+                        syntax_error("syntax error near |\n");
+                        return -1;
+                    }
+                    if (add_word(cl, &n, &max, NULL) < 0)
+                        goto nomem;
+                    starts[++cl->nstages] = n;
+                    break;
             }
-            params[i] = (char) 0; /* dont need the & anymore */
+            continue;
         }
-        params[i + 1] = (char) 0;
 
-        /*----------------- End of argument parsing -----------------------*/
+        word = w; /* a word, up to the next blank or operator */
+        while (*r != '\0' && strchr(" \t\n|<>&", *r) == NULL) {
+            if (*r == '\\') {
+                if (*++r != '\0' && *r != '\n')
+                    *w++ = *r++;
+            } else if (*r == '\'') {
+                for (r++; *r != '\''; )
+                    if (*r == '\0') {
+                        syntax_error("syntax error: missing '\n");
+                        return -1;
+                    } else
+                        *w++ = *r++;
+                r++;
+            } else if (*r == '"') {
+                for (r++; *r != '"'; ) {
+                    if (*r == '\0') {
+                        syntax_error("syntax error: missing \"\n");
+                        return -1;
+                    }
+                    if (*r == '\\' && r[1] != '\0' && strchr("\"\\$`", r[1]) != NULL)
+                        r++;
+                    *w++ = *r++;
+                }
+                r++;
+            } else
+                *w++ = *r++;
+        }
+        *w++ = '\0';
+        if (target != NULL) {
+            *target = word;
+            target = NULL;
+        } else if (add_word(cl, &n, &max, word) < 0)
+            goto nomem;
+    }
+    if (target != NULL) {
+        syntax_error("syntax error: no file after %s\n", target == &cl->in ? "<" : ">");
+        return -1;
+    }
+    cl->words[n] = NULL;
+    for (i = 0; i <= cl->nstages; i++)
+        cl->stage[i] = cl->words + starts[i];
 
-        /*----------------- Check for internal commands -------------------*/
+    if (n == starts[cl->nstages]) { /* last command empty */
+        if (cl->nstages == 0 && cl->in == NULL && cl->out == NULL && !cl->background)
+            return 0;
+        syntax_error("syntax error: missing command\n");
+        return -1;
+    }
+    cl->nstages++;
+    return 0;
+
+nomem:
+    syntax_error("out of memory\n");
+    return -1;
+}
+
+/* limited:  whether lp holds a resource limit for the child to set */
+static int limited(const struct limits *lp) {
+
+    int i;
+    for (i = 0; i < NLIMITS; i++)
+        if (lp->value[i] != RLIM_INFINITY)
+            return 1;
+    return 0;
+}
+
+/*
+ * exec_child:  in a new child, move in and out to stdin and stdout, lower
+ * the limits to lp and exec path.  If that fails errno is written to
+ * errfd and the child exits.
+ */
+static void exec_child(const char *path, char **argv, int in, int out,
+        const struct limits *lp, int errfd) {
+
+    struct rlimit rl;
+    sigset_t nomask;
+    int err, i;
+
+    sigemptyset(&nomask);
+    sigprocmask(SIG_SETMASK, &nomask, NULL);
+    if ((in != STDIN_FILENO && dup2(in, STDIN_FILENO) < 0) ||
+            (out != STDOUT_FILENO && dup2(out, STDOUT_FILENO) < 0))
+        goto fail;
+    for (i = 0; i < NLIMITS; i++) {
+        if (lp->value[i] == RLIM_INFINITY || getrlimit(limit_names[i].resource, &rl) < 0)
+            continue;
+        /* never above the hard limit, a CPU limit sends SIGXCPU before SIGKILL */
+        if (rl.rlim_max == RLIM_INFINITY || lp->value[i] < rl.rlim_max)
+            rl.rlim_max = lp->value[i] + (limit_names[i].resource == RLIMIT_CPU);
+        rl.rlim_cur = lp->value[i] < rl.rlim_max ? lp->value[i] : rl.rlim_max;
+        if (setrlimit(limit_names[i].resource, &rl) < 0)
+            goto fail;
+    }
+    execve(path, argv, environ);
+fail:
+    err = errno;
+    write(errfd, &err, sizeof (err));
+    _exit(127);
+}
+
+/*
+ * exec_error:  wait for the exec of child pid, which reports failure on
+ * the pipe fd.  Returns 0 or the errno value of the failure, in which case
+ * the child has been reaped.
+ */
+static int exec_error(pid_t pid, int *fd) {
+
+    int err;
+
+    close(fd[1]);
+    if (read(fd[0], &err, sizeof (err)) != sizeof (err))
+        err = 0; /* the exec closed the pipe */
+    close(fd[0]);
+    if (err != 0)
+        waitpid(pid, NULL, 0);
+    return err;
+}
+
+/*
+ * Zygote.  With -z a small helper is forked before the shell has grown
+ * and it starts the commands: the shell sends the path, the argument
+ * vector, the limits and the descriptors for stdin and stdout over a
+ * socketpair, the zygote forks the child from its own small address space
+ * and answers with the pid or an errno value.  The child is made with
+ * CLONE_PARENT, so it is a child of the shell and is reaped by it like
+ * any other.  The zygote keeps a copy of the environment and current
+ * directory of the shell, they are sent again after a builtin that may
+ * have changed them.
+ */
+#define Z_SPAWN 1 /* path, then the arguments */
+#define Z_STATE 2 /* current directory, then the environment */
+
+struct zmsg {
+    int type;
+    int in, out; /* a descriptor for stdin and stdout comes along */
+    int nstr; /* strings after the message */
+    struct limits lim;
+};
+
+struct zreply {
+    pid_t pid;
+    int err;
+};
+
+static int zygote = -1; /* socket to the zygote, -1 if there is none */
+static int zstate = 1, zsent = 0; /* changes of the shell state, the last one sent */
+
+/* zsend:  send message m with the strings in str and the descriptors in fd */
+static int zsend(int sock, struct zmsg *m, char **str, int *fd, int nfd) {
+
+    char cbuf[CMSG_SPACE(2 * sizeof (int))];
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    struct iovec iov;
+    size_t len = sizeof (*m), n;
+    char *buf;
+    int i;
+
+    for (i = 0; i < m->nstr; i++)
+        len += strlen(str[i]) + 1;
+    if ((buf = arena_alloc(len)) == NULL)
+        return -1;
+    memcpy(buf, m, sizeof (*m));
+    for (i = 0, n = sizeof (*m); i < m->nstr; i++, n += strlen(buf + n) + 1)
+        strcpy(buf + n, str[i]);
+
+    memset(&mh, 0, sizeof (mh));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    mh.msg_iov = &iov;
+    mh.msg_iovlen = 1;
+    if (nfd > 0) {
+        mh.msg_control = cbuf;
+        mh.msg_controllen = CMSG_SPACE(nfd * sizeof (int));
+        cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(nfd * sizeof (int));
+        memcpy(CMSG_DATA(cm), fd, nfd * sizeof (int));
+    }
+    while (sendmsg(sock, &mh, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return 0;
+}
+
+/*
+ * zspawn:  have the zygote start argv from path, like spawn.  Returns -1
+ * if the zygote cannot be reached.
+ */
+static int zspawn(pid_t *pid, const char *path, char **argv, int in, int out,
+        const struct limits *lp) {
+
+    struct zreply r;
+    struct zmsg m;
+    char cwd[4096], **str;
+    int fd[2], n = 0, i;
+
+    if (zsent != zstate) {
+        for (i = 0; environ[i] != NULL; i++)
+            ;
+        if (getcwd(cwd, sizeof (cwd)) == NULL || (str = arena_alloc((i + 1) * sizeof (char *))) == NULL)
+            return -1;
+        str[0] = cwd;
+        memcpy(str + 1, environ, i * sizeof (char *));
+        memset(&m, 0, sizeof (m));
+        m.type = Z_STATE;
+        m.nstr = i + 1;
+        if (zsend(zygote, &m, str, NULL, 0) < 0)
+            return -1;
+        zsent = zstate;
+    }
+
+    for (i = 0; argv[i] != NULL; i++)
+        ;
+    if ((str = arena_alloc((i + 1) * sizeof (char *))) == NULL)
+        return -1;
+    str[0] = (char *) path;
+    memcpy(str + 1, argv, i * sizeof (char *));
+    memset(&m, 0, sizeof (m));
+    m.type = Z_SPAWN;
+    m.nstr = i + 1;
+    m.lim = *lp;
+    if ((m.in = in != STDIN_FILENO))
+        fd[n++] = in;
+    if ((m.out = out != STDOUT_FILENO))
+        fd[n++] = out;
+    if (zsend(zygote, &m, str, fd, n) < 0)
+        return -1;
+
+    while ((n = recv(zygote, &r, sizeof (r), 0)) < 0 && errno == EINTR)
+        ;
+    if (n != sizeof (r))
+        return -1;
+    *pid = r.pid;
+    if (r.err != 0 && r.pid > 0)
+        waitpid(r.pid, NULL, 0); /* it is ours, not the zygote's */
+    return r.err;
+}
+
+/* zygote_main:  serve requests on sock until the shell goes away */
+static void zygote_main(int sock) {
+
+    char cbuf[CMSG_SPACE(2 * sizeof (int))], *buf = NULL, *state = NULL, *p;
+    char **str = NULL, **envv = NULL;
+    struct msghdr mh;
+    struct cmsghdr *cm;
+    struct iovec iov;
+    struct zmsg m;
+    struct zreply r;
+    size_t size = 0, nstr = 0;
+    ssize_t len;
+    int fd[2], pipefd[2], in, out, i, nfd;
+
+    for (;;) {
+        /* the whole message, however long */
+        if ((len = recv(sock, NULL, 0, MSG_PEEK | MSG_TRUNC)) <= 0) {
+            if (len < 0 && errno == EINTR)
+                continue;
+            _exit(0);
+        }
+        if ((size_t) len + 1 > size) {
+            free(buf);
+            size = len + 1;
+            if ((buf = malloc(size)) == NULL)
+                _exit(1);
+        }
+        memset(&mh, 0, sizeof (mh));
+        iov.iov_base = buf;
+        iov.iov_len = size;
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = cbuf;
+        mh.msg_controllen = sizeof (cbuf);
+        if ((len = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC)) < (ssize_t) sizeof (m))
+            _exit(len < 0);
+        buf[len] = '\0';
+        memcpy(&m, buf, sizeof (m));
+        nfd = 0;
+        if ((cm = CMSG_FIRSTHDR(&mh)) != NULL && cm->cmsg_type == SCM_RIGHTS) {
+            nfd = (cm->cmsg_len - CMSG_LEN(0)) / sizeof (int);
+            memcpy(fd, CMSG_DATA(cm), nfd * sizeof (int));
+        }
+
+        /* the strings after it */
+        if ((size_t) m.nstr + 1 > nstr) {
+            free(str);
+            nstr = m.nstr + 1;
+            if ((str = malloc(nstr * sizeof (char *))) == NULL)
+                _exit(1);
+        }
+        for (i = 0, p = buf + sizeof (m); i < m.nstr; i++, p += strlen(p) + 1)
+            str[i] = p;
+        str[m.nstr] = NULL;
+
+        if (m.type == Z_STATE) { /* keep the message, environ points into it */
+            chdir(str[0]);
+            free(state);
+            free(envv);
+            state = buf;
+            envv = str;
+            environ = str + 1;
+            buf = NULL;
+            size = 0;
+            str = NULL;
+            nstr = 0;
+            continue;
+        }
+
+        in = m.in ? fd[0] : STDIN_FILENO;
+        out = m.out ? fd[m.in] : STDOUT_FILENO;
+        r.pid = -1;
+        if (pipe2(pipefd, O_CLOEXEC) < 0)
+            r.err = errno;
+        else if ((r.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, 0, NULL, NULL, 0)) < 0) {
+            r.err = errno;
+            close(pipefd[0]);
+            close(pipefd[1]);
+        } else if (r.pid == 0)
+            exec_child(str[0], str + 1, in, out, &m.lim, pipefd[1]);
+        else { /* the shell reaps it if the exec failed */
+            close(pipefd[1]);
+            if (read(pipefd[0], &r.err, sizeof (r.err)) != sizeof (r.err))
+                r.err = 0;
+            close(pipefd[0]);
+        }
+        for (i = 0; i < nfd; i++)
+            close(fd[i]);
+        send(sock, &r, sizeof (r), 0);
+    }
+}
+
+/* start_zygote:  fork the zygote, the shell keeps the other end of the socket */
+static int start_zygote(void) {
+
+    int sv[2];
+    pid_t pid;
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+        return -1;
+    if ((pid = fork()) < 0) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (pid == 0) {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
+    zygote = sv[0];
+    return 0;
+}
+
+/*
+ * spawn:  start argv from path with stdin and stdout moved to in and out,
+ * returns 0 or an errno value.  posix_spawn cannot lower the limits of
+ * the child, so when lp has any the child is forked, sets them and execs
+ * itself; a failed exec is reported back through a close-on-exec pipe.
+ * With a zygote it is asked to do the fork instead.
+ */
+static int spawn(pid_t *pid, const char *path, char **argv, int in, int out,
+        const struct limits *lp, posix_spawnattr_t *attr) {
+
+    posix_spawn_file_actions_t actions;
+    int fd[2], err;
+
+    if (zygote >= 0) {
+        if ((err = zspawn(pid, path, argv, in, out, lp)) >= 0)
+            return err;
+        fprintf(stderr, "zygote not answering, commands are started by the shell\n");
+        close(zygote);
+        zygote = -1;
+    }
+
+    if (!limited(lp)) {
+        posix_spawn_file_actions_init(&actions);
+        if (in != STDIN_FILENO)
+            posix_spawn_file_actions_adddup2(&actions, in, STDIN_FILENO);
+        if (out != STDOUT_FILENO)
+            posix_spawn_file_actions_adddup2(&actions, out, STDOUT_FILENO);
+        err = posix_spawn(pid, path, &actions, attr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        return err;
+    }
+
+    if (pipe2(fd, O_CLOEXEC) < 0)
+        return errno;
+    if ((*pid = fork()) < 0) {
+        err = errno;
+        close(fd[0]);
+        close(fd[1]);
+        return err;
+    }
+    if (*pid == 0)
+        exec_child(path, argv, in, out, lp, fd[1]);
+    return exec_error(*pid, fd);
+}
+
+/*
+ * follow:  remember the n processes in pid as a background job, lost if
+ * the last command of the line is not among them
+ */
+static void follow(pid_t *pid, int n, int lost, const struct timespec *start, const struct cmdline *cl) {
 
-        if (strcmp(params[0], "exit") == 0) { /* Check for exit */
-            printf("----Bye----\n");
-            exit(0); /* exiting shell */
+    struct job *jp;
+    struct proc *p;
+    int i;
 
-        } else if (strcmp(params[0], "cd") == 0) { /* Check for cd */
-            if (chdir(params[1]) < 0) {
-                chdir(home); /* if directory not found, go to home directory */
+    if ((jp = free_jobs) != NULL)
+        free_jobs = jp->next;
+    else if ((jp = malloc(sizeof (*jp))) == NULL) {
+        fprintf(stderr, "out of memory, job %d not followed\n", pid[n - 1]);
+        return;
+    }
+    memcpy(jp->pid, pid, n * sizeof (pid_t));
+    jp->n = jp->left = 0;
+    jp->last = pid[n - 1];
+    jp->lost = lost;
+    jp->status = lost ? NOEXEC : 0;
+    jp->line = lineno;
+    jp->timed = cl->timed;
+    jp->limited = limited(&cl->lim) || cl->lim.wall > 0;
+    jp->start = *start;
+    memset(&jp->ru, 0, sizeof (jp->ru));
+    for (i = 0; i < n; i++) {
+        if ((p = free_procs) != NULL)
+            free_procs = p->next;
+        else if ((p = malloc(sizeof (*p))) == NULL) {
+            fprintf(stderr, "out of memory, process %d not followed\n", pid[i]);
+            continue;
+        }
+        p->pid = pid[i];
+        p->job = jp;
+        p->next = proctab[pid[i] % NPROCHASH];
+        proctab[pid[i] % NPROCHASH] = p;
+        jp->left++;
+    }
+    jp->n = n;
+    if (jp->left == 0) {
+        jp->next = free_jobs;
+        free_jobs = jp;
+        return;
+    }
+    set_deadline(jp, cl->lim.wall);
+    njobs++;
+}
+
+/*
+ * run:  start all commands of cl at once, each reading the pipe from the
+ * one before, and wait for all of them unless cl runs in the background.
+ * The status reported for a pipeline is that of its last command, NOEXEC
+ * if that one could not be started.  In
+ * batch mode the job is followed instead and run only waits until fewer
+ * than maxjobs are running.
+ */
+static void run(struct cmdline *cl, posix_spawnattr_t *attr) {
+
+    struct cmdpath *cp;
+    struct job fg; /* the foreground job, for its wall-clock limit */
+    pid_t pid[MAXSTAGES], p;
+    int fd[2], in = STDIN_FILENO, out, next, status = 0, st;
+    int i, n = 0, left, err, last = 0;
+
+    /* process timing */
+    struct timespec start_time;
+    struct rusage ru, total;
+
+    if (cl->in != NULL && (in = open(cl->in, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror(cl->in);
+        return;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start_time); /* get start time for process */
+
+    for (i = 0; i < cl->nstages; i++) {
+        /* every descriptor is close-on-exec, only the dup2 copies survive */
+        next = -1;
+        out = STDOUT_FILENO;
+        if (i < cl->nstages - 1) {
+            if (pipe2(fd, O_CLOEXEC) < 0) {
+                perror("pipe");
+                break;
             }
-            /*----------------- End check for internal commands ----------------*/
-        } else { /*Fork and execute*/
-            sighold(SIGCHLD);
-            if ((pid = fork()) < 0) {
-                perror("Fork failed");
-                exit(errno);
+            out = fd[1];
+            next = fd[0];
+        } else if (cl->out != NULL) {
+            out = open(cl->out, O_WRONLY | O_CREAT | O_CLOEXEC | (cl->append ? O_APPEND : O_TRUNC), 0666);
+            if (out < 0) {
+                perror(cl->out);
+                break;
             }
+        }
 
-            gettimeofday(&start_time, NULL); /* get start time for process */
-            /*--------------------- In child ----------------------------------*/
-            if (pid == 0) { /* Child */
-                if (background < 1) {
-                    fprintf(stderr, "\nSpawned foreground process, pid: %d\n", getpid());
-                } else {
-                    fprintf(stderr, "\nSpawned background process, pid: %d\npromptc:", getpid());
-                }
+        if ((cp = path_lookup(cl->stage[i][0])) == NULL) {
+            err = ENOENT;
+        } else if ((err = spawn(&pid[n], cp->path, cl->stage[i], in, out, &cl->lim, attr)) == ENOENT &&
+                cp->path != cp->name) { /* moved since it was looked up */
+            path_forget(cl->stage[i][0]);
+            if ((cp = path_lookup(cl->stage[i][0])) != NULL)
+                err = spawn(&pid[n], cp->path, cl->stage[i], in, out, &cl->lim, attr);
+        }
+        if (err == 0)
+            cp->hits++;
 
+        if (in != STDIN_FILENO)
+            close(in);
+        if (out != STDOUT_FILENO)
+            close(out);
+        in = next;
 
-                if (execvp(params[0], params) < 0) {
-                    perror("exec failed");
-                    exit(errno);
-                }
-                /*--------------------- End Child --------------------------------*/
-                /*--------------------- Parent -----------------------------------*/
-            } else { /* Parent */
+        if (err != 0) {
+            if (!interactive)
+                fprintf(stderr, "line %d: ", lineno);
+            fprintf(stderr, "exec failed: %s: %s\n", cl->stage[i][0], strerror(err));
+            continue;
+        }
+        if (interactive)
+            fprintf(stderr, "\nSpawned %s process, pid: %d\n", cl->background ? "background" : "foreground", pid[n]);
+        last = i == cl->nstages - 1; /* pid[n - 1] is the last command */
+        n++;
+    }
+    if (in > STDIN_FILENO) /* a pipe nobody reads after an error */
+        close(in);
 
-                if (background < 1) {
-                    waitpid(pid, &status, 0); /*wait for child*/
+    if (n == 0) {
+        if (!interactive)
+            started++, failed++;
+        return;
+    }
+    if (!interactive) {
+        follow(pid, n, !last, &start_time, cl);
+        started++;
+        while (njobs >= maxjobs && wait_any() == 0)
+            ;
+        return;
+    }
+    if (cl->background) {
+        follow(pid, n, !last, &start_time, cl);
+        fprintf(stderr, "promptc:");
+        return;
+    }
 
-                    gettimeofday(&end_time, NULL); /* get end time for process */
+    /* wait for the children, background jobs that end meanwhile are reaped too */
+    memcpy(fg.pid, pid, n * sizeof (pid_t));
+    fg.n = n;
+    fg.start = start_time;
+    set_deadline(&fg, cl->lim.wall);
+    memset(&total, 0, sizeof (total));
+    if (!last)
+        status = NOEXEC;
+    for (left = n; left > 0; ) {
+        if ((p = wait_child(&st, &ru)) < 0) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        for (i = 0; i < n && pid[i] != p; i++)
+            ;
+        if (i == n) {
+            reaped(p, st, &ru);
+            continue;
+        }
+        fg.pid[i] = 0;
+        ru_add(&total, &ru);
+        if (i == n - 1 && last)
+            status = st;
+        left--;
+    }
+    drop_deadline(&fg);
+
+    /* print some information about process and its exit status */
+    if (n == 1)
+        fprintf(stderr, "\nForeground process: %d terminated.\n", pid[0]);
+    else
+        fprintf(stderr, "\nForeground pipeline of %d processes, last pid %d, terminated.\n", n, pid[n - 1]);
+    pr_usage(stderr, elapsed(&start_time), &total, cl->timed);
+    pr_exit(status, fg.killed ? fg.wall : 0);
+    printf("\n");
+}
+
+/*
+ * Input of the interactive shell.  Lines are read with read() into inbuf
+ * rather than through stdio, so that poll() on the descriptor tells
+ * whether more input is there.
+ */
+static char *inbuf = NULL;
+static size_t inlen = 0; /* bytes in inbuf */
+static size_t inpos = 0; /* where the next line starts */
+static size_t insize = 0;
+
+/*
+ * next_line:  the next line typed, NULL at end of input.  While it waits
+ * the shell also watches the signalfd sfd and reaps children that end
+ * right away, then repeats the prompt.  Lines typed ahead do not hold up
+ * the reaping, sfd is looked at before each of them is returned.
+ */
+static char *next_line(int sfd) {
 
-                    /* do runtime calculations*/
-                    runtime_s = end_time.tv_sec - start_time.tv_sec;
-                    runtime_ms = ((end_time.tv_usec)-(start_time.tv_usec)) / 1000.0;
+    struct pollfd fds[2];
+    struct signalfd_siginfo si;
+    char *nl, *line;
+    ssize_t got;
+    int ms, running;
 
-                    /* print some information about process and its exit status */
-                    fprintf(stderr, "\nForeground process: %d terminated.\nRuntime: %d s %.*f ms\n", pid, runtime_s, 3, runtime_ms);
-                    pr_exit(status);
-                    printf("\n");
+    for (;;) {
+        if (inpos < inlen && (nl = memchr(inbuf + inpos, '\n', inlen - inpos)) != NULL) {
+            if (read(sfd, &si, sizeof (si)) == sizeof (si)) { /* typed ahead, reap anyway */
+                while (read(sfd, &si, sizeof (si)) == sizeof (si))
+                    ;
+                if (reap() > 0)
+                    fflush(stdout);
+            }
+            *nl = '\0';
+            line = inbuf + inpos;
+            inpos = nl + 1 - inbuf;
+            return line;
+        }
+        if (inpos > 0) { /* keep only the part of a line read so far */
+            memmove(inbuf, inbuf + inpos, inlen - inpos);
+            inlen -= inpos;
+            inpos = 0;
+        }
+        if (inlen + 1 >= insize) {
+            if ((line = realloc(inbuf, insize > 0 ? 2 * insize : 4096)) == NULL) {
+                fprintf(stderr, "line too long\n");
+                inlen = 0;
+                continue;
+            }
+            inbuf = line;
+            insize = insize > 0 ? 2 * insize : 4096;
+        }
+
+        fflush(stdout); /* the prompt */
+        ms = expire(); /* until a job is out of time */
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        fds[1].fd = sfd;
+        fds[1].events = POLLIN;
+        if (poll(fds, 2, ms) < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("poll");
+            return NULL;
+        }
+        if (fds[1].revents & POLLIN) {
+            while (read(sfd, &si, sizeof (si)) == sizeof (si))
+                ;
+            running = njobs;
+            if (reap() > 0 && njobs < running) /* a job was reported */
+                printf("promptb: ");
+        }
+        if (fds[0].revents & (POLLIN | POLLHUP | POLLERR)) {
+            if ((got = read(STDIN_FILENO, inbuf + inlen, insize - inlen - 1)) < 0) {
+                if (errno == EINTR || errno == EAGAIN)
+                    continue;
+                perror("read");
+                return NULL;
+            }
+            if (got == 0) { /* end of input, maybe after a last line without newline */
+                if (inlen == 0)
+                    return NULL;
+                inbuf[inlen++] = '\n';
+            }
+            inlen += got;
+        }
+    }
+}
+
+/* shell_times:  time without a command, what the shell and its children used */
+static void shell_times(void) {
+
+    struct rusage self, children;
+    getrusage(RUSAGE_SELF, &self);
+    getrusage(RUSAGE_CHILDREN, &children);
+    printf("shell:    user %ld.%03ld s, sys %ld.%03ld s\n",
+            (long) self.ru_utime.tv_sec, (long) self.ru_utime.tv_usec / 1000,
+            (long) self.ru_stime.tv_sec, (long) self.ru_stime.tv_usec / 1000);
+    printf("children: user %ld.%03ld s, sys %ld.%03ld s\n",
+            (long) children.ru_utime.tv_sec, (long) children.ru_utime.tv_usec / 1000,
+            (long) children.ru_stime.tv_sec, (long) children.ru_stime.tv_usec / 1000);
+#ifdef KR_MALLOC
+    printf("heap:     %lu bytes\n", (unsigned long) malloc_footprint());
+#endif
+}
+
+/*
+ * leave:  exit the shell, in batch mode once all jobs are done.  A status
+ * below 0 means 0, or in batch mode 1 if any job failed.
+ */
+static void leave(int status) {
+
+    if (interactive) {
+        printf("----Bye----\n");
+        exit(status < 0 ? 0 : status); /* exiting shell */
+    }
+    drain();
+    if (failed)
+        fprintf(stderr, "small_shell: %d of %d jobs failed\n", failed, started);
+    exit(status >= 0 ? status : failed ? 1 : 0);
+}
+
+/* is_name:  does the word up to eq, the '=' in it, spell name exactly */
+static int is_name(const char *word, const char *eq, const char *name) {
+
+    return strlen(name) == (size_t) (eq - word) && strncmp(word, name, eq - word) == 0;
+}
+
+/*
+ * limit_words:  read the name=value words at the start of params into
+ * lp, "unlimited" for a value removes the limit.  Returns the number of
+ * words read or -1 after reporting a bad one.
+ */
+static int limit_words(char **params, struct limits *lp) {
+
+    char *eq, *end;
+    double v;
+    int n, i;
+
+    for (n = 0; params[n] != NULL && (eq = strchr(params[n], '=')) != NULL; n++) {
+        for (i = 0; i < NLIMITS && !is_name(params[n], eq, limit_names[i].name); i++)
+            ;
+        if (i == NLIMITS && !is_name(params[n], eq, "wall"))
+            break; /* not a limit */
+        if (strcmp(eq + 1, "unlimited") == 0)
+            v = -1;
+        else if ((v = strtod(eq + 1, &end)) < 0 || end == eq + 1 || *end != '\0') {
+            syntax_error("limit: bad value %s\n", params[n]);
+            return -1;
+        } else if (!(v < (i == NLIMITS ? (double) MAXWALL : (double) RLIM_INFINITY / limit_names[i].unit))) {
+            syntax_error("limit: value too big %s\n", params[n]); /* or nan */
+            return -1;
+        }
+        if (i == NLIMITS)
+            lp->wall = v < 0 ? 0 : v;
+        else
+            lp->value[i] = v < 0 ? RLIM_INFINITY : (rlim_t) v * limit_names[i].unit;
+    }
+    return n;
+}
+
+/*
+ * Builtins.  These run inside the shell, without starting a process, when
+ * they make up the whole line; "< file" and "> file" still apply.  In a
+ * pipeline the program of the same name is run instead.  Builtins that
+ * change the state of the shell wait for the running batch jobs first.
+ */
+static int exit_cmd(char **params) {
+
+    leave(params[1] != NULL ? atoi(params[1]) : -1);
+    return 0;
+}
+
+static int cd_cmd(char **params) {
+
+    char *home = getenv("HOME");
+    if (chdir(params[1] != NULL ? params[1] : home) < 0) {
+        if (home != NULL)
+            chdir(home); /* if directory not found, go to home directory */
+        return 1;
+    }
+    return 0;
+}
+
+static int echo_cmd(char **params) {
+
+    int i = 1, nl = 1;
+    if (params[1] != NULL && strcmp(params[1], "-n") == 0) {
+        nl = 0;
+        i++;
+    }
+    for (; params[i] != NULL; i++)
+        printf(params[i + 1] != NULL ? "%s " : "%s", params[i]);
+    if (nl)
+        printf("\n");
+    return 0;
+}
+
+static int pwd_cmd(char **params) {
+
+    char buf[4096];
+    if (getcwd(buf, sizeof (buf)) == NULL) {
+        perror("pwd");
+        return 1;
+    }
+    printf("%s\n", buf);
+    return 0;
+}
+
+static int true_cmd(char **params) {
+
+    return 0;
+}
+
+static int false_cmd(char **params) {
+
+    return 1;
+}
+
+/* export_cmd:  export NAME=VALUE..., without arguments list the environment */
+static int export_cmd(char **params) {
+
+    char **ep, *eq;
+    int i, status = 0;
+
+    if (params[1] == NULL)
+        for (ep = environ; *ep != NULL; ep++)
+            printf("export %s\n", *ep);
+    for (i = 1; params[i] != NULL; i++) {
+        if ((eq = strchr(params[i], '=')) == NULL) /* already exported */
+            continue;
+        *eq = '\0';
+        if (setenv(params[i], eq + 1, 1) < 0) {
+            perror("export");
+            status = 1;
+        }
+        *eq = '=';
+    }
+    return status;
+}
+
+/*
+ * limit:  with name=value words, limit every command started from now on;
+ * without, list the limits.  "limit name=value command" limits only
+ * that command and is handled with the other prefixes in main.
+ */
+static int limit_cmd(char **params) {
+
+    int i;
+
+    if (params[1] != NULL)
+        return limit_words(params + 1, &shell_limits) < 0;
+    for (i = 0; i < NLIMITS; i++)
+        if (shell_limits.value[i] == RLIM_INFINITY)
+            printf("%s=unlimited\n", limit_names[i].name);
+        else
+            printf("%s=%lu\n", limit_names[i].name,
+                    (unsigned long) (shell_limits.value[i] / limit_names[i].unit));
+    if (shell_limits.wall > 0)
+        printf("wall=%g\n", shell_limits.wall);
+    else
+        printf("wall=unlimited\n");
+    return 0;
+}
+
+static int unset_cmd(char **params) {
+
+    int i;
+    for (i = 1; params[i] != NULL; i++)
+        unsetenv(params[i]);
+    return 0;
+}
+
+static struct builtin {
+    const char *name;
+    int (*fn)(char **);
+    int barrier; /* changes the shell, wait for batch jobs */
+} builtins[] = {
+    { "exit", exit_cmd, 1 },
+    { "cd", cd_cmd, 1 },
+    { "hash", hash_cmd, 1 },
+    { "export", export_cmd, 1 },
+    { "unset", unset_cmd, 1 },
+    { "echo", echo_cmd, 0 },
+    { "pwd", pwd_cmd, 0 },
+    { "true", true_cmd, 0 },
+    { ":", true_cmd, 0 },
+    { "false", false_cmd, 0 },
+    { "limit", limit_cmd, 0 },
+    { NULL, NULL, 0 }
+};
+
+/* find_builtin:  the builtin called name, NULL if there is none */
+static struct builtin *find_builtin(const char *name) {
+
+    struct builtin *bp;
+    for (bp = builtins; bp->name != NULL; bp++)
+        if (strcmp(bp->name, name) == 0)
+            return bp;
+    return NULL;
+}
+
+/* run_builtin:  run bp in the shell with the redirections of cl */
+static int run_builtin(struct builtin *bp, struct cmdline *cl) {
+
+    int saved_in = -1, saved_out = -1, fd, status;
+
+    if (bp->barrier)
+        drain();
+    if (cl->in != NULL) {
+        if ((fd = open(cl->in, O_RDONLY)) < 0) {
+            perror(cl->in);
+            return 1;
+        }
+        saved_in = dup(STDIN_FILENO);
+        dup2(fd, STDIN_FILENO);
+        close(fd);
+    }
+    if (cl->out != NULL) {
+        if ((fd = open(cl->out, O_WRONLY | O_CREAT | (cl->append ? O_APPEND : O_TRUNC), 0666)) < 0) {
+            perror(cl->out);
+            status = 1;
+            goto restore;
+        }
+        fflush(stdout);
+        saved_out = dup(STDOUT_FILENO);
+        dup2(fd, STDOUT_FILENO);
+        close(fd);
+    }
+
+    status = (*bp->fn)(cl->stage[0]);
+    if (bp->barrier) /* the zygote needs the new directory or environment */
+        zstate++;
+    fflush(stdout); /* before output of the commands that follow */
+
+restore:
+    if (saved_in >= 0) {
+        dup2(saved_in, STDIN_FILENO);
+        close(saved_in);
+    }
+    if (saved_out >= 0) {
+        dup2(saved_out, STDOUT_FILENO);
+        close(saved_out);
+    }
+    return status;
+}
+
+static void usage(char *progname) {
+
+    fprintf(stderr, "usage: %s [-iz] [-f file] [-j jobs]\n", progname);
+    exit(2);
+}
+
+/*
+ * batch_stdin:  when the batch is read from stdin, move it to a
+ * close-on-exec descriptor and leave /dev/null as stdin, so commands
+ * without a "<" cannot eat the lines after their own, as xargs does.
+ * Returns the script, NULL on error.
+ */
+static FILE *batch_stdin(void) {
+    FILE *fp;
+    int fd, null;
+
+    if ((fd = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 3)) < 0)
+        return NULL;
+    if ((null = open("/dev/null", O_RDONLY)) < 0) {
+        close(fd);
+        return NULL;
+    }
+    if ((fp = fdopen(fd, "r")) == NULL || dup2(null, STDIN_FILENO) < 0) {
+        if (fp != NULL)
+            fclose(fp);
+        else
+            close(fd);
+        close(null);
+        return NULL;
+    }
+    close(null);
+    return fp;
+}
+
+/*
+ *
+ */
+int main(int argc, char** argv) {
+
+    /* options */
+    FILE *input = stdin;
+    int force = 0, zflag = 0, opt, i;
+
+    while ((opt = getopt(argc, argv, "izf:j:")) != -1) {
+        switch (opt) {
+            case 'i':
+                force = 1;
+                break;
+            case 'z':
+                zflag = 1;
+                break;
+            case 'f':
+                if ((input = fopen(optarg, "re")) == NULL) {
+                    perror(optarg);
+                    return 1;
+                }
+                break;
+            case 'j':
+                maxjobs = atoi(optarg);
+                if (maxjobs < 1) {
+                    fprintf(stderr, "%s: -j takes a number above 0\n", argv[0]);
+                    return 2;
                 }
-                sigrelse(SIGCHLD);
-                /*------------------------- End Parent ---------------------------*/
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    interactive = input == stdin && (force || isatty(STDIN_FILENO));
+    if (!interactive && input == stdin && (input = batch_stdin()) == NULL) {
+        perror("stdin");
+        return 1;
+    }
+    if (zflag && start_zygote() < 0) /* while the shell is small */
+        perror("zygote");
+    for (i = 0; i < NLIMITS; i++)
+        shell_limits.value[i] = RLIM_INFINITY;
+
+    /*
+     * Signaling.  SIGCHLD stays blocked and is never delivered to a
+     * handler.  Interactively it is read from a signalfd next to the
+     * terminal and the children are reaped by the main loop, in batch
+     * mode they are reaped as the jobs are waited for.
+     */
+    sigset_t chld;
+    int sfd = -1;
+
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, NULL);
+    if (interactive && (sfd = signalfd(-1, &chld, SFD_NONBLOCK | SFD_CLOEXEC)) < 0) {
+        perror("signalfd");
+        return 1;
+    }
+
+    /*
+     * Commands are started with posix_spawn, which runs the new program
+     * without copying the page tables of the shell the way fork does, so
+     * launching stays cheap however big the shell grows.  The children get
+     * an empty signal mask instead of the one of the shell.
+     */
+    posix_spawnattr_t attr;
+    sigset_t nomask;
+    short flags = POSIX_SPAWN_SETSIGMASK;
+
+#ifdef POSIX_SPAWN_USEVFORK
+    flags |= POSIX_SPAWN_USEVFORK;
+#endif
+    sigemptyset(&nomask);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigmask(&attr, &nomask);
+    posix_spawnattr_setflags(&attr, flags);
+
+    /* command parsing */
+    char *line = NULL;
+    size_t linesize = 0;
+    struct cmdline cl;
+    struct builtin *bp;
+    char **params;
+    int status, nlim, prefixed;
+    struct timespec start;
+    struct rusage before, ru;
+
+    int background = 0;
+
+
+
+
+    while (1) {
+
+        arena_reset(); /* nothing of the last line is needed any more */
+
+        if (!interactive) { /* batch mode */
+            if (getline(&line, &linesize, input) < 0)
+                leave(-1);
+            lineno++;
+        } else {
+            if (background != 1) /* will duplicate prompt otherwise */
+                printf("prompt: ");
+
+            background = 0; /* reset to default process mode*/
+
+
+            if ((line = next_line(sfd)) == NULL)
+                leave(-1);
+        }
+
+        /*-------------- Start of argument parsing -----------------------*/
+
+        if (parse(line, &cl) < 0) {
+            if (!interactive)
+                started++, failed++;
+            continue;
+        }
+        if (cl.nstages == 0)
+            continue;
+        background = cl.background;
+        params = cl.stage[0];
+
+        if (strcmp(params[0], "time") == 0) { /* time the rest of the line */
+            if (params[1] == NULL) {
+                drain();
+                shell_times();
+                continue;
+            }
+            cl.timed = 1;
+            params = ++cl.stage[0];
+        }
+        cl.lim = shell_limits;
+        prefixed = 0;
+        if (strcmp(params[0], "limit") == 0 && params[1] != NULL) {
+            if ((nlim = limit_words(params + 1, &cl.lim)) < 0) {
+                if (!interactive)
+                    started++, failed++;
+                continue;
             }
+            if (params[nlim + 1] != NULL) { /* limit the rest of the line */
+                params = cl.stage[0] += nlim + 1;
+                prefixed = 1;
+            }
+        }
+
+        /*----------------- End of argument parsing -----------------------*/
+
+        /*----------------- Check for internal commands -------------------*/
 
+        if (cl.nstages == 1 && !prefixed && (bp = find_builtin(params[0])) != NULL) {
+            if (cl.timed) { /* a builtin runs in the shell, time the shell */
+                clock_gettime(CLOCK_MONOTONIC, &start);
+                getrusage(RUSAGE_SELF, &before);
+            }
+            status = run_builtin(bp, &cl);
+            if (cl.timed) {
+                getrusage(RUSAGE_SELF, &ru);
+                ru_since(&ru, &before);
+                pr_usage(stderr, elapsed(&start), &ru, 1);
+            }
+            if (!interactive) {
+                started++;
+                if (status != 0) {
+                    failed++;
+                    fprintf(stderr, "line %d: exit status %d\n", lineno, status);
+                }
+            }
+            /*----------------- End check for internal commands ----------------*/
+        } else { /*Spawn and execute*/
+            run(&cl, &attr);
         }
 
     }
     exit(0);
 }
-
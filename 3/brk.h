@@ -1,7 +1,9 @@
 #ifndef _brk_h_
 #define _brk_h_
 
+#include <stdint.h>
+
 extern int brk(void *);
-extern void *sbrk(int );
+extern void *sbrk(intptr_t);
 
 #endif /* _brk_h */
@@ -0,0 +1,114 @@
+/*
+ * heapmap.c -- arena snapshots and fragmentation maps, see heapmap.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include "malloc.h"
+#include "heapmap.h"
+
+/* take_block:  malloc_walk callback that records one block */
+static int take_block(void *block, size_t size, int used, void *ctx) {
+    heapsnap *hs = ctx;
+
+    if (hs->n == hs->max) {
+        hs->truncated = 1;
+        return 1;
+    }
+    hs->blocks[hs->n].addr = (unsigned long) block;
+    hs->blocks[hs->n].size = size;
+    hs->blocks[hs->n].used = used;
+    hs->n++;
+    return 0;
+}
+
+/* heapmap_snapshot:  record the arena into buf, returns number of blocks */
+int heapmap_snapshot(heapsnap *hs, heapblock *buf, int max) {
+
+    hs->blocks = buf;
+    hs->n = 0;
+    hs->max = max;
+    hs->truncated = 0;
+    malloc_walk(take_block, hs);
+    return hs->n;
+}
+
+/* heapmap_save:  write a snapshot as one "addr size used" line per block */
+int heapmap_save(FILE *fp, const heapsnap *hs) {
+    int i;
+
+    for (i = 0; i < hs->n; i++)
+        if (fprintf(fp, "%#lx %lu %d\n", hs->blocks[i].addr,
+                hs->blocks[i].size, hs->blocks[i].used) < 0)
+            return -1;
+    return 0;
+}
+
+/* heapmap_load:  read a snapshot written by heapmap_save */
+int heapmap_load(FILE *fp, heapsnap *hs, heapblock *buf, int max) {
+    heapblock b;
+
+    hs->blocks = buf;
+    hs->n = 0;
+    hs->max = max;
+    hs->truncated = 0;
+    while (fscanf(fp, "%lx %lu %d", &b.addr, &b.size, &b.used) == 3) {
+        if (hs->n == max) {
+            hs->truncated = 1;
+            break;
+        }
+        buf[hs->n++] = b;
+    }
+    return hs->n;
+}
+
+/* heapmap_render:  draw the snapshot in cells characters, width per line */
+void heapmap_render(FILE *fp, const heapsnap *hs, int cells, int width) {
+    unsigned long lo, hi, step, c0, c1, used = 0, avail = 0, largest = 0;
+    int i, b, cell, u, f;
+
+    if (hs->n == 0 || cells <= 0 || width <= 0) {
+        fprintf(fp, "(empty arena)\n");
+        return;
+    }
+    lo = hs->blocks[0].addr;
+    hi = hs->blocks[hs->n - 1].addr + hs->blocks[hs->n - 1].size;
+    step = (hi - lo + cells - 1) / cells;
+    if (step == 0)
+        step = 1;
+
+    for (cell = 0, b = 0; cell < cells; cell++) {
+        c0 = lo + cell * step;
+        c1 = c0 + step;
+        if (c0 >= hi)
+            break;
+        u = f = 0;
+        while (b < hs->n && hs->blocks[b].addr + hs->blocks[b].size <= c0)
+            b++;
+        for (i = b; i < hs->n && hs->blocks[i].addr < c1; i++) {
+            if (hs->blocks[i].used)
+                u = 1;
+            else
+                f = 1;
+        }
+        fputc(u && f ? '+' : u ? '#' : f ? '.' : ' ', fp);
+        if ((cell + 1) % width == 0)
+            fputc('\n', fp);
+    }
+    if (cell % width != 0)
+        fputc('\n', fp);
+
+    for (i = 0; i < hs->n; i++) {
+        if (hs->blocks[i].used) {
+            used += hs->blocks[i].size;
+        } else {
+            avail += hs->blocks[i].size;
+            if (hs->blocks[i].size > largest)
+                largest = hs->blocks[i].size;
+        }
+    }
+    fprintf(fp, "%d blocks, %lu bytes per cell, %lu used, %lu free, "
+            "largest free %lu, fragmentation %.2f%s\n",
+            hs->n, step, used, avail, largest,
+            avail ? 1.0 - (double) largest / avail : 0.0,
+            hs->truncated ? " (truncated)" : "");
+}
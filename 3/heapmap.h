@@ -0,0 +1,33 @@
+#ifndef _heapmap_h_
+#define _heapmap_h_
+
+#include <stdio.h>
+
+/*
+ * Snapshots of the arena taken with malloc_walk(), for looking at
+ * fragmentation offline.  A snapshot is a plain array of blocks in address
+ * order; it can be saved to and loaded from a text file and rendered as a
+ * map where every character stands for a fixed number of bytes:
+ *
+ *   '#'  allocated      '.'  free      '+'  both      ' '  outside arena
+ */
+
+typedef struct {
+    unsigned long addr;
+    unsigned long size;
+    int used;
+} heapblock;
+
+typedef struct {
+    heapblock *blocks;
+    int n; /* blocks in the snapshot */
+    int max; /* room in blocks */
+    int truncated; /* arena had more than max blocks */
+} heapsnap;
+
+extern int heapmap_snapshot(heapsnap *, heapblock *, int);
+extern int heapmap_save(FILE *, const heapsnap *);
+extern int heapmap_load(FILE *, heapsnap *, heapblock *, int);
+extern void heapmap_render(FILE *, const heapsnap *, int, int);
+
+#endif
@@ -0,0 +1,72 @@
+/*
+ *
+ * NAME:
+ *   heapview  -  draw the fragmentation map of a saved arena snapshot
+ *
+ * SYNTAX:
+ *   heapview [-c cells] [-w width] [file]
+ *
+ * DESCRIPTION:
+ *   heapview reads a snapshot written by heapmap_save(), from file or
+ *   from standard input, and draws it with heapmap_render(): one
+ *   character per cell, '#' allocated, '.' free, '+' both, followed by a
+ *   line with the totals and the fragmentation.  Snapshots can so be
+ *   taken in one run and looked at, or compared, later.
+ *
+ * OPTIONS:
+ *   -c cells      characters the arena is drawn in (default 1024)
+ *   -w width      characters per line (default 64)
+ *
+ * EXAMPLES:
+ *   heapview -c 4096 -w 128 arena.snap
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "heapmap.h"
+
+#define MAXBLOCKS (1 << 20) /* blocks read at most */
+
+static void usage(char *progname) {
+
+    fprintf(stderr, "usage: %s [-c cells] [-w width] [file]\n", progname);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    int cells = 1024, width = 64, opt;
+    heapblock *blocks;
+    heapsnap hs;
+    FILE *fp = stdin;
+
+    while ((opt = getopt(argc, argv, "c:w:")) != -1) {
+        switch (opt) {
+            case 'c':
+                cells = atoi(optarg);
+                break;
+            case 'w':
+                width = atoi(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (cells <= 0 || width <= 0 || argc - optind > 1)
+        usage(argv[0]);
+    if (optind < argc && (fp = fopen(argv[optind], "r")) == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if ((blocks = malloc(MAXBLOCKS * sizeof (heapblock))) == NULL) {
+        perror("malloc");
+        return 1;
+    }
+    heapmap_load(fp, &hs, blocks, MAXBLOCKS);
+    if (ferror(fp)) {
+        perror("read");
+        return 1;
+    }
+    heapmap_render(stdout, &hs, cells, width);
+    return 0;
+}
@@ -1,6 +1,17 @@
+#define _GNU_SOURCE /* mremap */
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include "malloc.h"
 
 #define FIRST_FIT 1
 #define BEST_FIT  2
@@ -16,25 +27,161 @@ int STRATEGY = 1;
 
 typedef long Align;
 
+/*
+ * Every block starts with a one unit header holding only its size and
+ * flags.  The link to the next free block is needed only while the block
+ * is free and is kept in the unit after the header, see NEXT().  Blocks
+ * are a multiple of ALIGN bytes and their headers sit ALIGN - sizeof
+ * (Header) bytes past an ALIGN boundary, so the memory handed out stays
+ * ALIGN aligned while an allocated block carries only 8 bytes overhead.
+ */
 union header {
 
     struct {
-        union header *ptr; /* pointer to next block */
-        unsigned size; /* blocksize */
+        unsigned size; /* blocksize in units */
+        unsigned flags; /* BLK_* bits */
     } s;
     Align x;
 };
 
 typedef union header Header;
 
+#define ALIGN 16 /* alignment of memory handed out */
+#define GRAIN (ALIGN / sizeof (Header)) /* units per ALIGN bytes */
+
+/*
+ * ALLOC_MAX:  largest request whose block size in units fits the header,
+ * with room left for the segment header and alignment morecore() adds.
+ */
+#define ALLOC_MAX (((size_t) UINT_MAX - 4 * GRAIN) / GRAIN * ALIGN - sizeof (Header) - ALIGN)
+
+/* NEXT:  link of free block p, in the unit after its header */
+#define NEXT(p) (*(Header **) ((p) + 1))
+
+#define BLK_RELEASED 0x1 /* interior pages handed back with madvise */
+#define BLK_FREE     0x2 /* block is on the free list */
+#define BLK_MMAPPED  0x4 /* block has a mapping of its own */
+#define BLK_SHORT    0x8 /* block belongs to the short-lived heap */
+#define BLK_SHARED   0x10 /* block belongs to the heap of other threads */
+
+#ifndef MMAP_MIN
+#define MMAP_MIN (128 * 1024) /* smallest request given its own mapping */
+#endif
+
+
+
+/*
+ * A heap is a free list over an arena.  Normally there is only the main
+ * heap; a persistent heap lives in a mapped file and keeps its Heap inside
+ * the file, see malloc_persist_open().  Where a heap gets more memory from
+ * is its page source (MALLOC_PAGES_*), see getpages().  The source only
+ * decides where new segments come from, so it can be changed at any time
+ * and segments of different sources share one free list.
+ */
+typedef struct {
+    Header base[2]; /* empty list to get started, base[1] is its link */
+    Header *freep; /* start of free list */
+    Header *segs; /* arena segments in address order */
+    int source; /* MALLOC_PAGES_* */
+    char *top, *end; /* unused part of a fixed region */
+    int fd; /* hugetlbfs file */
+    off_t off; /* used part of the hugetlbfs file */
+    unsigned long hugepage; /* page size of the hugetlbfs file */
+    unsigned mark; /* BLK_* bits every block of the heap carries */
+    unsigned long pending; /* bytes freed into large blocks since the last sweep */
+    unsigned ticks; /* calls to free() since the last sweep */
+} Heap;
+
+/* DYNAMIC:  heap h gets its memory from the kernel on demand */
+#define DYNAMIC(h) ((h)->source == MALLOC_PAGES_SBRK || (h)->source == MALLOC_PAGES_MMAP)
+
+static Heap sbrk_heap; /* the main heap, on sbrk memory by default */
+static Heap *heap = &sbrk_heap; /* the heap malloc() allocates from */
+
+/*
+ * Objects allocated with the MALLOC_SHORT_LIVED hint come from a heap of
+ * their own, on mmap'ed segments, so a burst of them never lies between
+ * long-lived objects.  Once the burst is freed a segment coalesces into a
+ * single free block and is unmapped, see trim_check().
+ */
+static Heap short_heap = { .source = MALLOC_PAGES_MMAP, .mark = BLK_SHORT };
+
+/*
+ * Threads other than the owner (see below) allocate from a heap of their
+ * own, shared among them and taken under a spin lock.  It is on mmap'ed
+ * segments and its blocks carry BLK_SHARED, so free() can return them
+ * under the lock from any thread.
+ */
+static Heap shared_heap = { .source = MALLOC_PAGES_MMAP, .mark = BLK_SHARED };
+static char shared_lock = 0;
+static Heap *heap_of(Header *);
+static Header *morecore(Heap *, unsigned);
+static void release_check(Heap *, Header *, unsigned);
+static void free_block(Header *);
+static void *mmap_block(size_t);
+static unsigned long page_size(void);
+
+/*
+ * Cross-thread frees.  The heap is owned by the first thread that calls
+ * malloc(), and only the owner allocates from it, without any locking.
+ * A free() from any other thread leaves the heap alone: the block is
+ * pushed on the remote list with a single compare-and-swap, linked
+ * through its header, and the owner takes the whole list with one
+ * exchange and frees it on its next call to malloc().  The free list
+ * itself is never touched concurrently.  Other threads that allocate get
+ * their blocks from the shared heap.
+ */
+static __thread char thread_tag; /* its address identifies the thread */
+static char *owner = NULL; /* &thread_tag of the owning thread */
+static Header *remote = NULL; /* blocks freed by other threads */
+
+/* mine:  is the calling thread the owner, it becomes one if there is none */
+static int mine(void) {
+    char *none = NULL;
+
+    if (__atomic_load_n(&owner, __ATOMIC_RELAXED) == &thread_tag)
+        return 1;
+    return __atomic_compare_exchange_n(&owner, &none, &thread_tag, 0,
+            __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+/* shared_enter, shared_leave:  take and drop the lock of the shared heap */
+static void shared_enter(void) {
+
+    while (__atomic_test_and_set(&shared_lock, __ATOMIC_ACQUIRE))
+        sched_yield();
+}
+
+static void shared_leave(void) {
 
+    __atomic_clear(&shared_lock, __ATOMIC_RELEASE);
+}
+
+/* remote_push:  hand block bp to the owner, safe from any thread */
+static void remote_push(Header *bp) {
+    Header *head;
+
+    head = __atomic_load_n(&remote, __ATOMIC_RELAXED);
+    do
+        NEXT(bp) = head;
+    while (!__atomic_compare_exchange_n(&remote, &head, bp, 1,
+            __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
 
-static Header base; /* empty list to get started */
-static Header *freep = NULL; /* start of free list */
-static Header *morecore(unsigned);
+/* remote_drain:  free every block pushed by other threads */
+static void remote_drain(void) {
+    Header *bp, *next;
 
-void *malloc(unsigned nbytes) {	
- 
+    if (__atomic_load_n(&remote, __ATOMIC_RELAXED) == NULL)
+        return;
+    for (bp = __atomic_exchange_n(&remote, NULL, __ATOMIC_ACQUIRE); bp != NULL; bp = next) {
+        next = NEXT(bp);
+        free_block(bp);
+    }
+}
+
+/* heap_alloc:  allocate nbytes from heap h */
+static void *heap_alloc(Heap *h, size_t nbytes) {
     Header *p, *prevp, *test_p, *test_prevp;
     test_p = NULL;
     test_prevp = NULL;
@@ -43,15 +190,22 @@ void *malloc(unsigned nbytes) {
 
     if (nbytes <= 0)
         return NULL;
+    if (nbytes >= MMAP_MIN && DYNAMIC(h))
+        return mmap_block(nbytes);
+    if (nbytes > ALLOC_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
 
-    nunits = (nbytes + sizeof (Header) - 1) / sizeof (Header) + 1;
-    if ((prevp = freep) == NULL) {
-        base.s.ptr = freep = prevp = &base;
-        base.s.size = 0;
+    nunits = (nbytes + sizeof (Header) + ALIGN - 1) / ALIGN * GRAIN;
+    if (h->freep == NULL) {
+        NEXT(h->base) = h->freep = h->base;
+        h->base->s.size = 0;
     }
+    prevp = h->freep;
 
     /* Try to find free block */
-    for (p = prevp->s.ptr;; prevp = p, p = p->s.ptr) {
+    for (p = NEXT(prevp);; prevp = p, p = NEXT(p)) {
 
         if (STRATEGY == FIRST_FIT) {
             if (p->s.size >= nunits) { /* big enough */
@@ -70,7 +224,7 @@ void *malloc(unsigned nbytes) {
                 }
             }
         }
-        if (p == freep && test_p != NULL) {
+        if (p == h->freep && test_p != NULL) {
             p = test_p;
             prevp = test_prevp;
             break;
@@ -89,7 +243,7 @@ void *malloc(unsigned nbytes) {
                     }
                 }
             }
-            if (p == freep && test_p != NULL) {
+            if (p == h->freep && test_p != NULL) {
                 p = test_p;
                 prevp = test_prevp;
                 break;
@@ -108,76 +262,605 @@ void *malloc(unsigned nbytes) {
                     }
                 }
             }
-            if (p == freep && test_p != NULL) {
+            if (p == h->freep && test_p != NULL) {
                 p = test_p;
                 prevp = test_prevp;
                 break;
             }
         }/* end quick_fit*/
 
-        if (p == freep) /* wrapped around free list */
-            if ((p = morecore(nunits)) == NULL)
+        if (p == h->freep) /* wrapped around free list */
+            if ((p = morecore(h, nunits)) == NULL)
                 return NULL; /* none left */
     }
 
     if (p->s.size == nunits) { /* exactly */
-        prevp->s.ptr = p->s.ptr;
+        NEXT(prevp) = NEXT(p);
     } else {
         p->s.size -= nunits;
         p += p->s.size;
         p->s.size = nunits;
     }
-    freep = prevp;
+    p->s.flags = h->mark;
+    h->freep = prevp;
     return (void *) (p + 1);
 }
 
-#define NALLOC  1024   /* minimum #units to request */
+/* shared_alloc:  allocate nbytes for a thread that is not the owner */
+static void *shared_alloc(size_t nbytes) {
+    void *p;
+
+    shared_enter();
+    p = heap_alloc(&shared_heap, nbytes);
+    shared_leave();
+    return p;
+}
+
+void *malloc(size_t nbytes) {
+
+    if (!mine())
+        return shared_alloc(nbytes);
+    remote_drain();
+    return heap_alloc(heap, nbytes);
+}
+
+/*
+ * malloc_hint:  allocate nbytes for an object with the expected lifetime
+ * hint.  Short-lived objects go to the short-lived heap unless the main
+ * heap is persistent or on fixed memory, where no other memory is used.
+ * Threads other than the owner always get theirs from the shared heap.
+ */
+void *malloc_hint(size_t nbytes, int hint) {
+
+    if (!mine())
+        return shared_alloc(nbytes);
+    remote_drain();
+    if (hint == MALLOC_SHORT_LIVED && heap == &sbrk_heap && DYNAMIC(heap))
+        return heap_alloc(&short_heap, nbytes);
+    return heap_alloc(heap, nbytes);
+}
+
+#define NALLOC  2048   /* minimum #units to request */
+
+/*
+ * The arena is kept as a list of segments, one per contiguous run of
+ * memory obtained from the page source.  Each segment starts ALIGN aligned
+ * with a SEGHDR unit header whose NEXT() links to the next segment and
+ * whose size covers the whole segment, itself included.  Within a segment
+ * the blocks lie back to back, so the arena can be walked block by block
+ * from the segment headers.  Units at the end of a segment too few for a
+ * block are its tail; they start the block when the segment is extended.
+ */
+#define SEGHDR (GRAIN + 1) /* puts the first block header off the boundary */
+#define SEGTAIL(sp) (((sp)->s.size - SEGHDR) % GRAIN)
+
+#define MMAP_CHUNK (64 * 1024) /* mmap source maps at least this much */
+
+static unsigned long footprint = 0; /* bytes obtained for segments and large blocks */
+
+/* getpages:  *nu units from the page source of h, *nu may be rounded up */
+static char *getpages(Heap *h, unsigned *nu) {
+    size_t len = *nu * sizeof (Header);
+    char *cp;
+
+    switch (h->source) {
+        case MALLOC_PAGES_MMAP:
+            len = (len + MMAP_CHUNK - 1) & ~(size_t) (MMAP_CHUNK - 1);
+            cp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (cp == MAP_FAILED)
+                return NULL;
+            break;
+        case MALLOC_PAGES_HUGETLB:
+            len = (len + h->hugepage - 1) & ~(size_t) (h->hugepage - 1);
+            if (ftruncate(h->fd, h->off + len) < 0)
+                return NULL;
+            cp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, h->fd, h->off);
+            if (cp == MAP_FAILED)
+                return NULL;
+            h->off += len;
+            break;
+        case MALLOC_PAGES_REGION:
+            if ((size_t) (h->end - h->top) < len)
+                len = (h->end - h->top) / sizeof (Header) * sizeof (Header);
+            if (len < (SEGHDR + 2 * GRAIN) * sizeof (Header))
+                return NULL;
+            cp = h->top;
+            h->top += len;
+            break;
+        default:
+            if ((cp = sbrk(len)) == (char *) - 1) /* no space at all */
+                return NULL;
+    }
+    *nu = len / sizeof (Header);
+    __atomic_fetch_add(&footprint, len, __ATOMIC_RELAXED);
+    return cp;
+}
 
 /* morecore:  ask system for more memory */
-static Header *morecore(unsigned nu) {
+static Header *morecore(Heap *h, unsigned nu) {
     char *cp;
-    Header *up;
+    Header *up, *sp, **spp;
 
+    nu += SEGHDR + GRAIN - 1; /* room for a segment header and alignment */
     if (nu < NALLOC)
         nu = NALLOC;
-    cp = sbrk(nu * sizeof (Header));
-    if (cp == (char *) - 1) /* no space at all */
+    if ((cp = getpages(h, &nu)) == NULL)
         return NULL;
     up = (Header *) cp;
+    for (sp = h->segs; sp != NULL; sp = NEXT(sp))
+        if (sp + sp->s.size == up)
+            break;
+    if (sp != NULL) { /* continues a segment */
+        up -= SEGTAIL(sp);
+        sp->s.size += nu;
+        nu = (sp + sp->s.size - up) / GRAIN * GRAIN;
+    } else { /* start a new segment */
+        while ((unsigned long) up % ALIGN != 0) {
+            up++;
+            nu--;
+        }
+        for (spp = &h->segs; *spp != NULL && *spp < up; spp = &NEXT(*spp))
+            ;
+        NEXT(up) = *spp;
+        up->s.size = nu;
+        up->s.flags = 0;
+        *spp = up;
+        up += SEGHDR;
+        nu = (nu - SEGHDR) / GRAIN * GRAIN;
+    }
     up->s.size = nu;
-    free((void *) (up + 1));
-    return freep;
+    up->s.flags = BLK_RELEASED | h->mark; /* fresh pages are not resident yet */
+    free_block(up);
+    return h->freep;
+}
+
+/*
+ * Release of free memory.  The page-aligned interior of a large free block
+ * is handed back to the kernel with madvise(MADV_DONTNEED), which lowers
+ * RSS without moving the break.  The header stays resident, so the free
+ * list is left intact, and the block is marked BLK_RELEASED; its pages are
+ * faulted back in (zero filled) when the block is handed out again.
+ *
+ * RELEASE_MIN     smallest free block, in bytes, worth releasing
+ * RELEASE_PENDING sweep once this many bytes were freed into large blocks
+ * RELEASE_DELAY   sweep at the latest this many calls to free() after a
+ *                 large block was freed
+ *
+ * Setting RELEASE_PENDING or RELEASE_DELAY to 0 disables that trigger.
+ */
+#ifndef RELEASE_MIN
+#define RELEASE_MIN     (64 * 1024)
+#endif
+#ifndef RELEASE_PENDING
+#define RELEASE_PENDING (256 * 1024)
+#endif
+#ifndef RELEASE_DELAY
+#define RELEASE_DELAY   1024
+#endif
+
+/* page_size:  the system page size */
+static unsigned long page_size(void) {
+    static unsigned long pagesize = 0;
+
+    if (pagesize == 0)
+        pagesize = sysconf(_SC_PAGESIZE);
+    return pagesize;
+}
+
+/* release_block:  give the interior pages of free block p back */
+static void release_block(Header *p) {
+    unsigned long pagesize = page_size();
+    unsigned long lo, hi;
+
+    lo = ((unsigned long) (p + 2) + pagesize - 1) & ~(pagesize - 1);
+    hi = (unsigned long) (p + p->s.size) & ~(pagesize - 1);
+    if (hi > lo && madvise((void *) lo, hi - lo, MADV_DONTNEED) < 0)
+        return;
+    p->s.flags |= BLK_RELEASED;
 }
 
-/* free:  put block ap in free list */
+/* release_sweep:  release every large free block of h not yet released */
+static void release_sweep(Heap *h) {
+    Header *p;
+
+    for (p = NEXT(h->base); p != h->base; p = NEXT(p))
+        if (!(p->s.flags & BLK_RELEASED) &&
+                p->s.size * sizeof (Header) >= RELEASE_MIN)
+            release_block(p);
+    h->pending = 0;
+    h->ticks = 0;
+}
+
+/* release_check:  account nu units just freed into block p of h */
+static void release_check(Heap *h, Header *p, unsigned nu) {
+
+    if (!DYNAMIC(h)) /* no system calls for fixed memory */
+        return;
+    if (!(p->s.flags & BLK_RELEASED) &&
+            p->s.size * sizeof (Header) >= RELEASE_MIN)
+        h->pending += nu * sizeof (Header);
+    if (h->pending == 0)
+        return;
+    h->ticks++;
+    if ((RELEASE_PENDING && h->pending >= RELEASE_PENDING) ||
+            (RELEASE_DELAY && h->ticks >= RELEASE_DELAY))
+        release_sweep(h);
+}
+
+/*
+ * Large blocks.  Requests of MMAP_MIN bytes and more get a mapping of
+ * their own instead of a piece of the arena.  The header sits MMAP_PAD
+ * units into the mapping, to keep the data ALIGN aligned, and its size
+ * counts the whole mapping, so free() can unmap it from any thread and
+ * realloc() can grow it with mremap(), which moves page table entries
+ * instead of copying the data.  These blocks are not part of the arena and
+ * are not seen by malloc_walk().  MMAP_MAX is the largest request whose
+ * mapping the size of a header can still count; bigger ones fail with
+ * ENOMEM before any rounding.
+ */
+#define MMAP_PAD (GRAIN - 1)
+#define MMAP_LEN(n) (((n) + ALIGN + page_size() - 1) & ~(page_size() - 1))
+#define MMAP_MAX ((size_t) UINT_MAX * sizeof (Header) - ALIGN - page_size())
+
+/* is_mmapped:  does block bp have a mapping of its own */
+static int is_mmapped(Header *bp) {
+
+    return (bp->s.flags & BLK_MMAPPED) &&
+            ((unsigned long) (bp - MMAP_PAD) & (page_size() - 1)) == 0;
+}
+
+/* mmap_block:  map a block for nbytes */
+static void *mmap_block(size_t nbytes) {
+    size_t len;
+    Header *bp;
+
+    if (nbytes > MMAP_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    len = MMAP_LEN(nbytes);
+    bp = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bp == MAP_FAILED)
+        return NULL;
+    bp += MMAP_PAD;
+    bp->s.size = len / sizeof (Header);
+    bp->s.flags = BLK_MMAPPED;
+    __atomic_fetch_add(&footprint, len, __ATOMIC_RELAXED);
+    return (void *) (bp + 1);
+}
+
+/* mremap_block:  resize the mapping of block bp to hold nbytes */
+static void *mremap_block(Header *bp, size_t nbytes) {
+    size_t len, old = bp->s.size * sizeof (Header);
+
+    if (nbytes > MMAP_MAX) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    len = MMAP_LEN(nbytes);
+    bp = mremap(bp - MMAP_PAD, old, len, MREMAP_MAYMOVE);
+    if (bp == MAP_FAILED)
+        return NULL;
+    bp += MMAP_PAD;
+    bp->s.size = len / sizeof (Header);
+    __atomic_fetch_add(&footprint, len - old, __ATOMIC_RELAXED);
+    return (void *) (bp + 1);
+}
+
+/* free:  put block ap in free list, or pass it to the owner or the shared heap */
 void free(void *ap) {
+    size_t len;
 
     if (ap == NULL)
         return;
 
-    Header *bp, *p;
+    if (is_mmapped((Header *) ap - 1)) {
+        len = ((Header *) ap - 1)->s.size * sizeof (Header);
+        __atomic_fetch_sub(&footprint, len, __ATOMIC_RELAXED);
+        munmap((Header *) ap - 1 - MMAP_PAD, len);
+    } else if (((Header *) ap - 1)->s.flags & BLK_SHARED) {
+        shared_enter();
+        free_block((Header *) ap - 1);
+        shared_leave();
+    } else if (owner != NULL && owner != &thread_tag)
+        remote_push((Header *) ap - 1);
+    else
+        free_block((Header *) ap - 1);
+}
+
+/*
+ * trim_check:  unmap the segment of the short-lived heap h that free
+ * block bp now covers, returns 1 if it did.  The last segment is kept so
+ * that a heap used for one object at a time does not map and unmap on
+ * every call, and a block still BLK_RELEASED is one morecore() has just
+ * added.
+ */
+static int trim_check(Heap *h, Header *bp) {
+    Header *sp, **spp, *p;
+    size_t len;
+
+    if (h != &short_heap || NEXT(h->segs) == NULL || (bp->s.flags & BLK_RELEASED))
+        return 0;
+    sp = bp - SEGHDR;
+    if (((unsigned long) sp & (page_size() - 1)) != 0)
+        return 0;
+    for (spp = &h->segs; *spp != NULL && *spp != sp; spp = &NEXT(*spp))
+        ;
+    if (*spp == NULL || bp + bp->s.size != sp + sp->s.size - SEGTAIL(sp))
+        return 0;
+    for (p = h->freep; NEXT(p) != bp; p = NEXT(p))
+        ;
+    NEXT(p) = NEXT(bp);
+    h->freep = p;
+    *spp = NEXT(sp);
+    len = sp->s.size * sizeof (Header);
+    __atomic_fetch_sub(&footprint, len, __ATOMIC_RELAXED);
+    munmap(sp, len);
+    return 1;
+}
+
+/* free_block:  put block bp in free list of its heap */
+static void free_block(Header *bp) {
+    Heap *h = heap_of(bp);
+    Header *p;
+    unsigned nu;
 
-    bp = (Header *) ap - 1; /* point to  block header */
-    for (p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
-        if (p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+    bp->s.flags |= BLK_FREE;
+    nu = bp->s.size;
+    for (p = h->freep; !(bp > p && bp < NEXT(p)); p = NEXT(p))
+        if (p >= NEXT(p) && (bp > p || bp < NEXT(p)))
             break; /* freed block at start or end of arena */
 
-    if (bp + bp->s.size == p->s.ptr) { /* join to upper nbr */
-        bp->s.size += p->s.ptr->s.size;
-        bp->s.ptr = p->s.ptr->s.ptr;
+    if (bp + bp->s.size == NEXT(p)) { /* join to upper nbr */
+        bp->s.size += NEXT(p)->s.size;
+        bp->s.flags &= NEXT(p)->s.flags;
+        NEXT(bp) = NEXT(NEXT(p));
     } else
-        bp->s.ptr = p->s.ptr;
+        NEXT(bp) = NEXT(p);
     if (p + p->s.size == bp) { /* join to lower nbr */
         p->s.size += bp->s.size;
-        p->s.ptr = bp->s.ptr;
+        p->s.flags &= bp->s.flags;
+        NEXT(p) = NEXT(bp);
+        bp = p;
     } else
-        p->s.ptr = bp;
-    freep = p;
+        NEXT(p) = bp;
+    h->freep = p;
+    if (!trim_check(h, bp))
+        release_check(h, bp, nu);
+}
+
+/*
+ * Persistent heap.  The arena is a file mapped MAP_SHARED at a fixed
+ * address, so pointers stored in it stay valid from one run to the next.
+ * The file starts with a Pheader that holds the Heap itself, so the free
+ * list is saved along with the objects, and a table of root pointers from
+ * which a restarted process finds its data again.  While the file is open
+ * malloc() allocates from it and free() returns each block to the heap it
+ * came from.  The image is marked clean only by malloc_persist_close(), and
+ * an image that was not closed is not trusted on the next open.
+ */
+#define PERSIST_MAGIC   0x6d616c6c6f637032UL /* "mallocp2" */
+
+typedef struct {
+    unsigned long magic;
+    char *addr; /* where the file must be mapped */
+    size_t size; /* of the file and the mapping */
+    int clean; /* closed with malloc_persist_close() */
+    void *root[MALLOC_ROOTS];
+    Heap heap;
+} Pheader;
+
+static Pheader *persist = NULL; /* the open persistent heap */
+
+/* heap_of:  the heap block bp belongs to */
+static Heap *heap_of(Header *bp) {
+
+    if (persist != NULL && (char *) bp >= persist->addr &&
+            (char *) bp < persist->addr + persist->size)
+        return &persist->heap;
+    if (bp->s.flags & BLK_SHORT)
+        return &short_heap;
+    if (bp->s.flags & BLK_SHARED)
+        return &shared_heap;
+    return &sbrk_heap;
+}
+
+/* malloc_persist_open:  map the persistent heap in file path */
+int malloc_persist_open(const char *path, void *addr, size_t size) {
+    struct stat st;
+    Pheader *ph;
+    int fd, resumed, flags = MAP_SHARED;
+
+    if (persist != NULL || ((unsigned long) addr & (page_size() - 1)) != 0 ||
+            size < page_size()) {
+        errno = EINVAL;
+        return -1;
+    }
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+        return -1;
+    if (fstat(fd, &st) < 0)
+        goto fail;
+    resumed = st.st_size > 0;
+    if (resumed)
+        size = st.st_size;
+    else if (ftruncate(fd, size) < 0)
+        goto fail;
+#ifdef MAP_FIXED_NOREPLACE
+    flags |= MAP_FIXED_NOREPLACE;
+#endif
+    ph = mmap(addr, size, PROT_READ | PROT_WRITE, flags, fd, 0);
+    if (ph == MAP_FAILED)
+        goto fail;
+    close(fd);
+    if ((void *) ph != addr) {
+        munmap(ph, size);
+        errno = EEXIST;
+        return -1;
+    }
+
+    if (resumed) {
+        if (ph->magic != PERSIST_MAGIC || ph->addr != addr || ph->size != size) {
+            munmap(ph, size);
+            errno = EINVAL;
+            return -1;
+        }
+        if (!ph->clean) {
+            munmap(ph, size);
+            errno = EUCLEAN;
+            return -1;
+        }
+    } else {
+        memset(ph, 0, sizeof (Pheader));
+        ph->magic = PERSIST_MAGIC;
+        ph->addr = addr;
+        ph->size = size;
+        NEXT(ph->heap.base) = ph->heap.freep = ph->heap.base;
+        ph->heap.source = MALLOC_PAGES_REGION;
+        ph->heap.top = (char *) addr + (sizeof (Pheader) + ALIGN - 1) / ALIGN * ALIGN;
+        ph->heap.end = (char *) addr + size;
+    }
+    ph->clean = 0;
+    msync(ph, page_size(), MS_SYNC);
+    persist = ph;
+    heap = &ph->heap;
+    return resumed;
+
+fail:
+    close(fd);
+    return -1;
+}
+
+/* malloc_persist_sync:  write the persistent heap back to its file */
+int malloc_persist_sync(void) {
+
+    if (persist == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    return msync(persist, persist->size, MS_SYNC);
+}
+
+/* malloc_persist_close:  mark the image clean and unmap it */
+int malloc_persist_close(void) {
+    Pheader *ph = persist;
+
+    if (ph == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (msync(ph, ph->size, MS_SYNC) < 0)
+        return -1;
+    ph->clean = 1;
+    if (msync(ph, page_size(), MS_SYNC) < 0)
+        return -1;
+    heap = &sbrk_heap;
+    persist = NULL;
+    return munmap(ph, ph->size);
+}
+
+/* malloc_root:  root pointer i of the persistent heap */
+void *malloc_root(int i) {
+
+    if (persist == NULL || i < 0 || i >= MALLOC_ROOTS)
+        return NULL;
+    return persist->root[i];
+}
+
+/* malloc_set_root:  set root pointer i of the persistent heap to p */
+int malloc_set_root(int i, void *p) {
+
+    if (persist == NULL || i < 0 || i >= MALLOC_ROOTS) {
+        errno = EINVAL;
+        return -1;
+    }
+    persist->root[i] = p;
+    return 0;
+}
+
+/*
+ * Page sources of the main heap.  Segments already obtained stay where
+ * they are; only memory needed from now on comes from the new source.
+ * With a region or hugetlbfs source no memory is released with madvise
+ * and large blocks are carved from the arena like any other.
+ */
+
+/* malloc_pages:  take new memory from sbrk or anonymous mmap */
+int malloc_pages(int source) {
+
+    if (persist != NULL || (source != MALLOC_PAGES_SBRK && source != MALLOC_PAGES_MMAP)) {
+        errno = EINVAL;
+        return -1;
+    }
+    sbrk_heap.source = source;
+    return 0;
+}
+
+/* malloc_pages_region:  take new memory from the size bytes at addr */
+int malloc_pages_region(void *addr, size_t size) {
+    char *lo, *hi;
+
+    lo = (char *) (((unsigned long) addr + sizeof (Header) - 1) & ~(sizeof (Header) - 1));
+    hi = (char *) addr + size;
+    if (persist != NULL || addr == NULL || hi < lo) {
+        errno = EINVAL;
+        return -1;
+    }
+    sbrk_heap.top = lo;
+    sbrk_heap.end = hi;
+    sbrk_heap.source = MALLOC_PAGES_REGION;
+    return 0;
+}
+
+/* malloc_pages_hugetlb:  take new memory from a file on the hugetlbfs dir */
+int malloc_pages_hugetlb(const char *dir) {
+    char path[4096];
+    struct statfs fs;
+    int fd;
+
+    if (persist != NULL || sbrk_heap.source == MALLOC_PAGES_HUGETLB) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (snprintf(path, sizeof (path), "%s/mallocXXXXXX", dir) >= (int) sizeof (path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    if ((fd = mkstemp(path)) < 0)
+        return -1;
+    unlink(path);
+    if (fstatfs(fd, &fs) < 0 || fs.f_bsize <= 0) {
+        close(fd);
+        return -1;
+    }
+    sbrk_heap.fd = fd;
+    sbrk_heap.off = 0;
+    sbrk_heap.hugepage = fs.f_bsize;
+    sbrk_heap.source = MALLOC_PAGES_HUGETLB;
+    return 0;
+}
+
+/* malloc_footprint:  bytes obtained from all page sources and not returned */
+size_t malloc_footprint(void) {
+
+    return __atomic_load_n(&footprint, __ATOMIC_RELAXED);
+}
+
+/* malloc_walk:  call fn for every block of the arena in address order */
+int malloc_walk(malloc_walker *fn, void *ctx) {
+    Header *sp, *p;
+    int r;
+
+    for (sp = heap->segs; sp != NULL; sp = NEXT(sp))
+        for (p = sp + SEGHDR; p < sp + sp->s.size - SEGTAIL(sp) && p->s.size > 0; p += p->s.size)
+            if ((r = (*fn)((void *) p, p->s.size * sizeof (Header),
+                    !(p->s.flags & BLK_FREE), ctx)) != 0)
+                return r;
+    return 0;
 }
 
 void *realloc(void *ptr, size_t new_size) {
     Header *h_ptr;
-    int copy_size;
+    size_t copy_size;
     void *new_ptr;
 
     h_ptr = (Header *) ptr - 1;
@@ -189,15 +872,40 @@ void *realloc(void *ptr, size_t new_size) {
         free(ptr);
         return NULL;
     }
-    copy_size = (h_ptr->s.size - 1) * sizeof (Header);
+    if (is_mmapped(h_ptr) && new_size >= MMAP_MIN)
+        return mremap_block(h_ptr, new_size);
+
+    copy_size = (h_ptr->s.size - (is_mmapped(h_ptr) ? GRAIN : 1)) * sizeof (Header);
 
     if (new_size < copy_size)
         copy_size = new_size;
 
-    new_ptr = malloc(new_size);
+    if (h_ptr->s.flags & BLK_SHORT)
+        new_ptr = malloc_hint(new_size, MALLOC_SHORT_LIVED);
+    else
+        new_ptr = malloc(new_size);
+    if (new_ptr == NULL)
+        return NULL;
     memcpy(new_ptr, ptr, copy_size);
     free(ptr);
 
     return new_ptr;
 
 }
+
+/*
+ * calloc:  nmemb zeroed objects of size bytes.  Defined here so that a
+ * program linked with this malloc never gets a block from the C library
+ * allocator that it would then hand to free above.  It allocates with
+ * malloc_hint(), as the compiler turns malloc() followed by memset() into
+ * a call to calloc(), which here would call itself.
+ */
+void *calloc(size_t nmemb, size_t size) {
+    void *p;
+
+    if (size != 0 && nmemb > (size_t) -1 / size)
+        return NULL;
+    if ((p = malloc_hint(nmemb * size, MALLOC_LONG_LIVED)) != NULL)
+        memset(p, 0, nmemb * size);
+    return p;
+}
@@ -1,10 +1,81 @@
-
 #ifndef _malloc_h_
 #define _malloc_h_
 
 
 extern void *malloc(size_t);
 extern void *realloc(void *, size_t);
+extern void *calloc(size_t, size_t);
 extern void free(void *);
 
+/*
+ * Threads.  The heap belongs to the first thread that calls malloc() and
+ * that thread allocates without taking a lock.  Any other thread may
+ * allocate too, it gets its memory from a second heap shared by all of
+ * them under a lock, so allocating from many threads is correct but only
+ * the owner is fast.  free() and realloc() work from any thread; a block
+ * of the owner freed elsewhere is handed back to it without a lock.  Page
+ * sources, persistent heaps and malloc_walk concern the owner's heap.
+ */
+
+/*
+ * Lifetime hints.  malloc_hint allocates like malloc, and objects hinted
+ * MALLOC_SHORT_LIVED are kept apart from all others, so memory taken by a
+ * burst of them is given back once they are freed, however long the
+ * objects allocated in between live.  realloc keeps an object where it
+ * was.  The hint is ignored while a persistent heap is open or the heap
+ * has a region or hugetlbfs source.
+ */
+#define MALLOC_LONG_LIVED  0
+#define MALLOC_SHORT_LIVED 1
+
+extern void *malloc_hint(size_t, int);
+
+/*
+ * malloc_walk visits every block of the arena in address order.  The
+ * walker gets the block address, its size in bytes including the header
+ * and whether it is in use.  A non-zero return value stops the walk and
+ * is passed back to the caller.  The walker must not allocate or free.
+ * Large blocks with a mapping of their own, objects allocated with the
+ * MALLOC_SHORT_LIVED hint and blocks of threads other than the owner are
+ * not part of the arena.
+ */
+typedef int malloc_walker(void *block, size_t size, int used, void *ctx);
+
+extern int malloc_walk(malloc_walker *, void *);
+
+/*
+ * Persistent heap.  malloc_persist_open maps the file at addr, creating it
+ * with the given size if it is empty, and from then on malloc() allocates
+ * from it.  It returns 1 when an existing image was resumed, 0 for a new
+ * one and -1 with errno set on failure; EUCLEAN means the image was not
+ * closed properly.  Objects are found again through the root pointers.
+ * Everything allocated while the file is open goes into it, allocations
+ * made inside the C library included, so close it only when none of those
+ * are still in use.
+ */
+#define MALLOC_ROOTS 16
+
+extern int malloc_persist_open(const char *, void *, size_t);
+extern int malloc_persist_sync(void);
+extern int malloc_persist_close(void);
+extern void *malloc_root(int);
+extern int malloc_set_root(int, void *);
+
+/*
+ * Page sources.  By default the heap grows with sbrk.  New memory can
+ * instead come from anonymous mmap, from a region supplied by the caller
+ * (no system calls at all once the region is in use) or from a file on a
+ * hugetlbfs mount.  malloc_footprint is what has been obtained so far, for
+ * whatever source, large blocks with their own mapping included.
+ */
+#define MALLOC_PAGES_SBRK    0
+#define MALLOC_PAGES_MMAP    1
+#define MALLOC_PAGES_REGION  2
+#define MALLOC_PAGES_HUGETLB 3
+
+extern int malloc_pages(int);
+extern int malloc_pages_region(void *, size_t);
+extern int malloc_pages_hugetlb(const char *);
+extern size_t malloc_footprint(void);
+
 #endif
@@ -0,0 +1,124 @@
+/*
+ * perfctr.c -- performance counters for benchmarks, see perfctr.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "perfctr.h"
+
+#define CACHE(c, op, res) ((c) | (PERF_COUNT_HW_CACHE_OP_ ## op << 8) | \
+        (PERF_COUNT_HW_CACHE_RESULT_ ## res << 16))
+
+typedef struct {
+    const char *name;
+    unsigned type;
+    unsigned long long config;
+} pc_event;
+
+static const pc_event hardware[] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "L1d-misses", PERF_TYPE_HW_CACHE, CACHE(PERF_COUNT_HW_CACHE_L1D, READ, MISS) },
+    { "LLC-misses", PERF_TYPE_HW_CACHE, CACHE(PERF_COUNT_HW_CACHE_LL, READ, MISS) },
+    { "dTLB-misses", PERF_TYPE_HW_CACHE, CACHE(PERF_COUNT_HW_CACHE_DTLB, READ, MISS) },
+    { NULL, 0, 0 }
+};
+
+static const pc_event software[] = {
+    { "task-clock-ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK },
+    { "page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+    { "context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES },
+    { NULL, 0, 0 }
+};
+
+/* pc_add:  open the counters of list that the kernel allows */
+static void pc_add(perfctr *pc, const pc_event *list) {
+    struct perf_event_attr attr;
+    int fd;
+
+    for (; list->name != NULL && pc->n < PC_MAX; list++) {
+        memset(&attr, 0, sizeof (attr));
+        attr.size = sizeof (attr);
+        attr.type = list->type;
+        attr.config = list->config;
+        attr.disabled = 1;
+        attr.exclude_kernel = list->type != PERF_TYPE_SOFTWARE;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (fd < 0)
+            continue;
+        pc->fd[pc->n] = fd;
+        pc->name[pc->n] = list->name;
+        pc->value[pc->n] = 0;
+        pc->n++;
+    }
+}
+
+/* pc_open:  open counters for this thread, returns how many */
+int pc_open(perfctr *pc) {
+
+    pc->n = 0;
+    pc->software = 0;
+    pc_add(pc, hardware);
+    if (pc->n == 0) {
+        pc->software = 1;
+        pc_add(pc, software);
+    }
+    return pc->n;
+}
+
+/* pc_start:  zero and start all counters, note their times so far */
+void pc_start(perfctr *pc) {
+    unsigned long long buf[3]; /* value, time enabled, time running */
+    int i;
+
+    for (i = 0; i < pc->n; i++) {
+        ioctl(pc->fd[i], PERF_EVENT_IOC_RESET, 0);
+        pc->enabled[i] = pc->running[i] = 0;
+        if (read(pc->fd[i], buf, sizeof (buf)) == sizeof (buf)) {
+            pc->enabled[i] = buf[1];
+            pc->running[i] = buf[2];
+        }
+    }
+    for (i = 0; i < pc->n; i++)
+        ioctl(pc->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+}
+
+/*
+ * pc_stop:  stop all counters and read them.  The reset in pc_start
+ * zeroes only the count, so the multiplexing ratio is taken from the
+ * times of this run alone.
+ */
+void pc_stop(perfctr *pc) {
+    unsigned long long buf[3]; /* value, time enabled, time running */
+    unsigned long long enabled, running;
+    int i;
+
+    for (i = 0; i < pc->n; i++)
+        ioctl(pc->fd[i], PERF_EVENT_IOC_DISABLE, 0);
+    for (i = 0; i < pc->n; i++) {
+        pc->value[i] = 0;
+        if (read(pc->fd[i], buf, sizeof (buf)) != sizeof (buf))
+            continue;
+        enabled = buf[1] - pc->enabled[i];
+        running = buf[2] - pc->running[i];
+        if (running == 0)
+            continue;
+        pc->value[i] = enabled == running ? buf[0] :
+                (unsigned long long) ((double) buf[0] * enabled / running);
+    }
+}
+
+/* pc_close:  close all counters */
+void pc_close(perfctr *pc) {
+    int i;
+
+    for (i = 0; i < pc->n; i++)
+        close(pc->fd[i]);
+    pc->n = 0;
+}
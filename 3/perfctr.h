@@ -0,0 +1,29 @@
+#ifndef _perfctr_h_
+#define _perfctr_h_
+
+/*
+ * Thin wrapper around perf_event_open for the allocator benchmarks.
+ * pc_open opens the hardware counters the kernel lets us have (cycles,
+ * instructions, L1d/LLC misses, dTLB misses); when none are available it
+ * falls back to software counters (task clock, page faults, context
+ * switches).  Values are scaled when the kernel had to multiplex.
+ */
+
+#define PC_MAX 8
+
+typedef struct {
+    int n; /* open counters */
+    int software; /* hardware counters were not available */
+    int fd[PC_MAX];
+    const char *name[PC_MAX];
+    unsigned long long value[PC_MAX];
+    unsigned long long enabled[PC_MAX]; /* time enabled at pc_start */
+    unsigned long long running[PC_MAX]; /* time running at pc_start */
+} perfctr;
+
+extern int pc_open(perfctr *);
+extern void pc_start(perfctr *);
+extern void pc_stop(perfctr *);
+extern void pc_close(perfctr *);
+
+#endif
@@ -0,0 +1,86 @@
+/*
+ * pool.c -- fixed-size object pools, see pool.h
+ */
+#include <stdlib.h>
+#include "malloc.h"
+#include "pool.h"
+
+#define ALIGN 16 /* objects are aligned like malloc() blocks */
+
+typedef union chunk {
+    union chunk *next; /* chunks of the pool, for pool_destroy */
+    char x[ALIGN]; /* keeps the objects after it ALIGN aligned */
+} Chunk;
+
+typedef struct object {
+    struct object *next; /* next free object */
+} Object;
+
+struct pool {
+    size_t size; /* object size, rounded up */
+    int per_chunk; /* objects per chunk */
+    Object *freelist; /* freed objects */
+    char *unused, *end; /* never used part of the newest chunk */
+    Chunk *chunks;
+};
+
+/* pool_create:  pool of objects of size bytes, n of them per chunk */
+Pool *pool_create(size_t size, int n) {
+    Pool *pp;
+
+    if (size == 0 || n <= 0 || (pp = malloc(sizeof (Pool))) == NULL)
+        return NULL;
+    if (size < sizeof (Object))
+        size = sizeof (Object);
+    pp->size = (size + ALIGN - 1) / ALIGN * ALIGN;
+    pp->per_chunk = n;
+    pp->freelist = NULL;
+    pp->unused = pp->end = NULL;
+    pp->chunks = NULL;
+    return pp;
+}
+
+/* pool_alloc:  one object from pool pp */
+void *pool_alloc(Pool *pp) {
+    Object *op;
+    Chunk *cp;
+
+    if ((op = pp->freelist) != NULL) {
+        pp->freelist = op->next;
+        return op;
+    }
+    if (pp->unused == pp->end) { /* start a new chunk */
+        if ((cp = malloc(sizeof (Chunk) + pp->per_chunk * pp->size)) == NULL)
+            return NULL;
+        cp->next = pp->chunks;
+        pp->chunks = cp;
+        pp->unused = (char *) (cp + 1);
+        pp->end = pp->unused + pp->per_chunk * pp->size;
+    }
+    op = (Object *) pp->unused;
+    pp->unused += pp->size;
+    return op;
+}
+
+/* pool_free:  give object ap back to pool pp */
+void pool_free(Pool *pp, void *ap) {
+    Object *op = ap;
+
+    if (op == NULL)
+        return;
+    op->next = pp->freelist;
+    pp->freelist = op;
+}
+
+/* pool_destroy:  free pool pp and every object in it */
+void pool_destroy(Pool *pp) {
+    Chunk *cp, *next;
+
+    if (pp == NULL)
+        return;
+    for (cp = pp->chunks; cp != NULL; cp = next) {
+        next = cp->next;
+        free(cp);
+    }
+    free(pp);
+}
@@ -0,0 +1,21 @@
+#ifndef _pool_h_
+#define _pool_h_
+
+#include <stddef.h>
+
+/*
+ * Pools of fixed-size objects.  Objects are packed back to back in chunks
+ * taken from malloc(), carry no header and are recycled through a free
+ * list threaded through the free objects themselves, so pool_alloc and
+ * pool_free are a pointer pop and push.  Objects are 16 byte aligned
+ * like malloc() blocks; their size is rounded up to a multiple of 16.
+ * Memory goes back to malloc only when the pool is destroyed.
+ */
+typedef struct pool Pool;
+
+extern Pool *pool_create(size_t, int);
+extern void *pool_alloc(Pool *);
+extern void pool_free(Pool *, void *);
+extern void pool_destroy(Pool *);
+
+#endif
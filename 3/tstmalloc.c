@@ -1,13 +1,19 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
 #include "malloc.h"
 #include "tst.h"
 
 #define SIZE 10
 #define TIMES 30000
 
+char region[1 << 20];
+size_t huge[] = { SIZE_MAX - 10, (size_t) 32 << 30 }; /* more than a block can count */
+
 int main(int argc, char *argv[]){
   char *p, *q;
+  size_t i;
   char *progname;
   double *d;
 
@@ -52,6 +58,23 @@ int main(int argc, char *argv[]){
     MESSAGE("* ERROR: malloc(2 * sizeof(double)) returned NULL\n");
   d[0] = d[1] = (double)4711.4711;
   free(d);
+
+  MESSAGE("Allocate more than a block can hold from a fixed region\n");
+  if (malloc_pages_region(region, sizeof (region)) < 0)
+    MESSAGE("* ERROR: malloc_pages_region failed\n");
+  for (i = 0; i < sizeof (huge) / sizeof (huge[0]); i++){
+    errno = 0;
+    if ((p = malloc(huge[i])) != NULL){
+      MESSAGE("* ERROR: malloc of a huge size did not fail\n");
+      free(p);
+    } else if (errno != ENOMEM)
+      MESSAGE("* ERROR: malloc of a huge size did not set errno to ENOMEM\n");
+  }
+  if ((p = malloc(4711)) == NULL)
+    MESSAGE("* ERROR: malloc failed after a huge request\n");
+  else
+    p[4710] = 47;
+  free(p);
   return 0;
 }
 
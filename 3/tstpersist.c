@@ -0,0 +1,90 @@
+/*
+ * Builds a linked list in a persistent heap, closes it and opens it again.
+ * The list must be found through the root pointer with its contents
+ * intact, and the saved free list must be usable for new allocations.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "malloc.h"
+#include "tst.h"
+
+#define BASE ((void *) 0x600000000000UL)
+#define SIZE (4 << 20)
+#define NODES 1000
+
+typedef struct node {
+  struct node *next;
+  int value;
+  char name[20];
+} node;
+
+int count_used(void *block, size_t size, int used, void *ctx){
+  if (used)
+    ++*(int *) ctx;
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  char path[64];
+  node *n, *list = NULL;
+  int i, used = 0, errors = 0;
+  char *progname;
+
+  if (argc > 0)
+    progname = argv[0];
+  else
+    progname = "";
+
+  MESSAGE("-- Test the persistent heap\n");
+  sprintf(path, "/tmp/tstpersist.%d", (int) getpid());
+  if (malloc_persist_open(path, BASE, SIZE) != 0){
+    MESSAGE("* ERROR: Could not create persistent heap\n");
+    return 1;
+  }
+  for(i = 0; i < NODES; i++){
+    n = malloc(sizeof(node));
+    n->value = i;
+    sprintf(n->name, "node %d", i);
+    n->next = list;
+    list = n;
+    free(malloc(i % 50 + 1)); /* leave some holes behind */
+  }
+  malloc_set_root(0, list);
+  if (malloc_persist_close() < 0)
+    MESSAGE("* ERROR: Could not close persistent heap\n");
+
+  MESSAGE("Reopen the persistent heap\n");
+  if (malloc_persist_open(path, BASE, SIZE) != 1){
+    MESSAGE("* ERROR: Could not resume persistent heap\n");
+    unlink(path);
+    return 1;
+  }
+  for(i = NODES - 1, n = malloc_root(0); n != NULL; n = n->next, i--){
+    char name[20];
+    sprintf(name, "node %d", i);
+    if (n->value != i || strcmp(n->name, name) != 0)
+      errors++;
+  }
+  if (errors || i != -1)
+    MESSAGE("* ERROR: List in persistent heap was destroyed\n");
+
+  malloc_walk(count_used, &used);
+  if (used != NODES)
+    MESSAGE("* ERROR: Free list of persistent heap is inconsistent\n");
+
+  for(n = malloc_root(0); n != NULL; n = list){
+    list = n->next;
+    free(n);
+  }
+  n = malloc(SIZE / 2);
+  if (n == NULL)
+    MESSAGE("* ERROR: Freed blocks were not merged in persistent heap\n");
+  free(n);
+  malloc_persist_close();
+  unlink(path);
+  if (!errors && used == NODES && n != NULL)
+    MESSAGE("Test passed OK\n");
+  return 0;
+}
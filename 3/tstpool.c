@@ -0,0 +1,73 @@
+/*
+ * Checks fixed-size object pools: objects are aligned, packed back to back
+ * without headers, do not overlap, and freed objects are handed out again
+ * before new memory is used.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "pool.h"
+#include "tst.h"
+
+#define OBJSIZE 24
+#define STRIDE 32 /* OBJSIZE rounded up to the alignment */
+#define PERCHUNK 64
+#define TIMES 1000
+
+char *obj[TIMES];
+
+int main(int argc, char *argv[]){
+  Pool *pp;
+  char *p;
+  int i, errors = 0;
+  char *progname;
+
+  if (argc > 0)
+    progname = argv[0];
+  else
+    progname = "";
+
+  MESSAGE("-- Test fixed-size object pools\n");
+  if ((pp = pool_create(OBJSIZE, PERCHUNK)) == NULL){
+    MESSAGE("* ERROR: pool_create failed\n");
+    return 1;
+  }
+  for(i = 0; i < TIMES; i++){
+    if ((obj[i] = pool_alloc(pp)) == NULL){
+      MESSAGE("* ERROR: pool_alloc returned NULL\n");
+      return 1;
+    }
+    if ((unsigned long) obj[i] % 16 != 0)
+      errors++;
+    memset(obj[i], i, OBJSIZE);
+  }
+  if (errors)
+    MESSAGE("* ERROR: Objects are not aligned\n");
+
+  for(i = 1; i < PERCHUNK; i++)
+    if (obj[i] - obj[i-1] != STRIDE){
+      MESSAGE("* ERROR: Objects in a chunk are not packed together\n");
+      errors++;
+      break;
+    }
+
+  for(i = 0; i < TIMES; i++)
+    if (obj[i][0] != (char) i || obj[i][OBJSIZE-1] != (char) i){
+      MESSAGE("* ERROR: Objects overlap\n");
+      errors++;
+      break;
+    }
+
+  MESSAGE("Free and allocate again\n");
+  pool_free(pp, obj[10]);
+  pool_free(pp, obj[20]);
+  p = pool_alloc(pp);
+  if (p != obj[20] || pool_alloc(pp) != obj[10]){
+    MESSAGE("* ERROR: Freed objects were not reused\n");
+    errors++;
+  }
+  pool_destroy(pp);
+  if (errors == 0)
+    MESSAGE("Test passed OK\n");
+  return 0;
+}
@@ -1,12 +1,16 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
 #include "tst.h"
 
 #define SIZE 10
 #define TIMES 30000
 
+size_t huge = SIZE_MAX - 10; /* more than any heap can hold */
+
 int main(int argc, char *argv[]){
-  char *p;
+  char *p, *q;
   char *progname;
 
   if (argc > 0)
@@ -40,6 +44,47 @@ int main(int argc, char *argv[]){
     MESSAGE("Decreased block size\n");
   if ( p[0] != 17 || p[16] != 17 )
     MESSAGE("* ERROR: Data destroyed decreasing size with p = realloc(p, 17)\n");
+  MESSAGE("Increase block size with realloc(., 1 << 20)\n");
+  p = realloc(p, 1 << 20);
+  if (p == NULL){
+    MESSAGE("* ERROR: Could not increase block size to 1 MB\n");
+    return 1;
+  }
+  p[(1 << 20) - 1] = 47;
+  MESSAGE("Increase block size with realloc(., 16 << 20)\n");
+  p = realloc(p, 16 << 20);
+  if (p == NULL){
+    MESSAGE("* ERROR: Could not increase block size to 16 MB\n");
+    return 1;
+  }
+  if ( p[0] != 17 || p[16] != 17 || p[(1 << 20) - 1] != 47 )
+    MESSAGE("* ERROR: Data destroyed during p = realloc(p, 16 << 20)\n");
+  MESSAGE("Increase block size with realloc(., SIZE_MAX - 10)\n");
+  errno = 0;
+  q = realloc(p, huge);
+  if (q != NULL){
+    MESSAGE("* ERROR: realloc(p, SIZE_MAX - 10) did not fail\n");
+    p = q;
+  } else if (errno != ENOMEM)
+    MESSAGE("* ERROR: realloc(p, SIZE_MAX - 10) did not set errno to ENOMEM\n");
+  if ( p[0] != 17 || p[16] != 17 || p[(1 << 20) - 1] != 47 )
+    MESSAGE("* ERROR: Data destroyed by a failed realloc\n");
+  MESSAGE("Allocate SIZE_MAX - 10 bytes with malloc\n");
+  errno = 0;
+  q = malloc(huge);
+  if (q != NULL){
+    MESSAGE("* ERROR: malloc(SIZE_MAX - 10) did not fail\n");
+    free(q);
+  } else if (errno != ENOMEM)
+    MESSAGE("* ERROR: malloc(SIZE_MAX - 10) did not set errno to ENOMEM\n");
+  MESSAGE("Decrease block size with realloc(., 17)\n");
+  p = realloc(p, 17);
+  if (p == NULL){
+    MESSAGE("* ERROR: Could not decrease block size from 16 MB\n");
+    return 1;
+  }
+  if ( p[0] != 17 || p[16] != 17 )
+    MESSAGE("* ERROR: Data destroyed decreasing size from 16 MB\n");
   MESSAGE("Free block with realloc(., 0)\n");
   p = realloc(p, 0);
   if (p != NULL) 
@@ -0,0 +1,126 @@
+/*
+ * Checks the release of free memory: once enough large blocks are freed
+ * and coalesced, the interior pages of the free block are handed back to
+ * the kernel, and the block is handed out again correctly afterwards.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "malloc.h"
+#include "tst.h"
+
+#define BLOCKS 16
+#define SIZE (32 * 1024) /* below MMAP_MIN, so the blocks are in the arena */
+#define DELAY 1024 /* RELEASE_DELAY of malloc.c */
+
+char *p[BLOCKS];
+char *lo, *hi; /* range covered by the blocks */
+
+static int free_size;
+
+/* walker:  note the size of the free block that covers lo to hi */
+static int walker(void *block, size_t size, int used, void *ctx){
+
+  if (!used && (char *) block < lo && (char *) block + size >= hi)
+    free_size = size;
+  return 0;
+}
+
+/* resident:  pages of lo to hi still in memory */
+static int resident(void){
+  long pagesize = sysconf(_SC_PAGESIZE);
+  unsigned char vec[BLOCKS * SIZE / 4096 + 2];
+  char *a, *b;
+  int i, n = 0;
+
+  a = (char *) (((unsigned long) lo + pagesize - 1) & ~(pagesize - 1));
+  b = (char *) ((unsigned long) hi & ~(pagesize - 1));
+  if (b - a > (long) sizeof (vec) * pagesize || mincore(a, b - a, vec) < 0)
+    return -1;
+  for(i = 0; i < (b - a) / pagesize; i++)
+    n += vec[i] & 1;
+  return n;
+}
+
+int main(int argc, char *argv[]){
+  int i, j, n, errors = 0;
+  char *progname;
+
+  if (argc > 0)
+    progname = argv[0];
+  else
+    progname = "";
+
+  MESSAGE("-- Test release of large free blocks\n");
+  lo = NULL;
+  hi = NULL;
+  for(i = 0; i < BLOCKS; i++){
+    if ((p[i] = malloc(SIZE)) == NULL){
+      MESSAGE("* ERROR: malloc returned NULL\n");
+      return 1;
+    }
+    memset(p[i], i + 1, SIZE);
+    if (lo == NULL || p[i] < lo)
+      lo = p[i];
+    if (hi == NULL || p[i] + SIZE > hi)
+      hi = p[i] + SIZE;
+  }
+  if (hi - lo > 2 * BLOCKS * SIZE){
+    MESSAGE("* ERROR: Blocks are not next to each other\n");
+    return 1;
+  }
+
+  MESSAGE("Free the blocks, they coalesce into one\n");
+  for(i = 0; i < BLOCKS; i++)
+    free(p[i]);
+  for(i = 0; i < DELAY; i++) /* release is due at the latest now */
+    free(malloc(16));
+  malloc_walk(walker, NULL);
+  if (free_size == 0){
+    MESSAGE("* ERROR: Freed blocks were not coalesced\n");
+    errors++;
+  }
+  n = resident();
+  fprintf(stderr, "%s: free block of %d bytes, %d pages of it resident\n",
+          progname, free_size, n);
+  if (n != 0){
+    MESSAGE("* ERROR: Pages of the free block were not released\n");
+    errors++;
+  }
+
+  MESSAGE("Allocate the blocks again\n");
+  for(i = 0; i < BLOCKS; i++){
+    if ((p[i] = malloc(SIZE)) == NULL){
+      MESSAGE("* ERROR: malloc returned NULL\n");
+      return 1;
+    }
+    if (p[i] < lo - 16 || p[i] + SIZE > hi + 16){
+      MESSAGE("* ERROR: Released block was not reused\n");
+      errors++;
+      break;
+    }
+    memset(p[i], 'a' + i, SIZE);
+  }
+  for(i = 0; i < BLOCKS; i++)
+    for(j = 0; j < SIZE; j += 4096)
+      if (p[i][j] != 'a' + i || p[i][SIZE-1] != 'a' + i){
+        MESSAGE("* ERROR: Blocks overlap after reuse\n");
+        errors++;
+        i = BLOCKS;
+        break;
+      }
+  for(i = 0; i < BLOCKS; i++)
+    free(p[i]);
+
+  free_size = 0;
+  malloc_walk(walker, NULL);
+  if (free_size == 0){
+    MESSAGE("* ERROR: Reused blocks did not coalesce again\n");
+    errors++;
+  }
+  if (errors == 0)
+    MESSAGE("Test passed OK\n");
+  return 0;
+}
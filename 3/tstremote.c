@@ -0,0 +1,119 @@
+/*
+ * Allocates on the main thread and frees on another one.  The frees go
+ * through the remote list and should be back on the free list after the
+ * next malloc() of the owner, so a second round of the same allocations
+ * must not grow the break.  Then other threads allocate and free at the
+ * same time as the owner, which they do from the shared heap.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "malloc.h"
+#include "tst.h"
+
+#define SIZE 1000
+#define ROUNDS 20
+#define SMALLSTRING 100
+#define THREADS 4
+#define LIVE 64
+#define TIMES 100000
+
+char *a[SIZE];
+
+/* churn:  allocate and free objects tagged with *arg, check the tags */
+void *churn(void *arg){
+  char *live[LIVE] = { NULL };
+  int i, k, n, tag = *(int *) arg;
+
+  for(i = 0; i < TIMES; i++){
+    k = i % LIVE;
+    if (live[k] != NULL){
+      n = (i - LIVE) % 500 + 1;
+      if (live[k][0] != (char) tag || live[k][n-1] != (char) tag){
+        *(int *) arg = -1;
+        return NULL;
+      }
+      free(live[k]);
+    }
+    n = i % 500 + 1;
+    if ((live[k] = malloc(n)) == NULL){
+      *(int *) arg = -1;
+      return NULL;
+    }
+    memset(live[k], tag, n);
+  }
+  for(k = 0; k < LIVE; k++)
+    free(live[k]);
+  return NULL;
+}
+
+void *consumer(void *arg){
+  int i;
+
+  for(i = 0; i < SIZE; i++){
+    if(a[i][0] != (char) i)
+      *(int *) arg = 1;
+    free(a[i]);
+  }
+  return NULL;
+}
+
+int main(int argc, char *argv[]){
+  int i, r, corrupt = 0, tags[THREADS + 1];
+  pthread_t tids[THREADS];
+  char *lowbreak, *highbreak = NULL;
+  pthread_t tid;
+  char *progname;
+
+  if (argc > 0)
+    progname = argv[0];
+  else
+    progname = "";
+
+  MESSAGE("-- Test free() from a thread that does not own the heap\n");
+  free(malloc(1));
+  lowbreak = sbrk(0);
+  for(r = 0; r < ROUNDS; r++){
+    for(i = 0; i < SIZE; i++){
+      a[i] = malloc(SMALLSTRING);
+      a[i][0] = (char) i;
+    }
+    if(pthread_create(&tid, NULL, consumer, &corrupt) != 0 ||
+       pthread_join(tid, NULL) != 0){
+      MESSAGE("* ERROR: Could not run consumer thread\n");
+      return 1;
+    }
+    if(r == 1)
+      highbreak = sbrk(0);
+  }
+  if(corrupt)
+    MESSAGE("* ERROR: Data destroyed between threads\n");
+  fprintf(stderr, "%s: Break grew %ld bytes in round 1, %ld bytes after\n",
+	  progname, (long)(highbreak - lowbreak), (long)((char *)sbrk(0) - highbreak));
+  if((char *)sbrk(0) != highbreak){
+    MESSAGE("* ERROR: Remotely freed blocks were not reused\n");
+    return 0;
+  }
+
+  MESSAGE("Allocate from other threads at the same time as the owner\n");
+  for(i = 0; i <= THREADS; i++)
+    tags[i] = i + 1;
+  for(i = 0; i < THREADS; i++)
+    if(pthread_create(&tids[i], NULL, churn, &tags[i]) != 0){
+      MESSAGE("* ERROR: Could not run allocating thread\n");
+      return 1;
+    }
+  churn(&tags[THREADS]);
+  for(i = 0; i < THREADS; i++)
+    pthread_join(tids[i], NULL);
+  for(i = 0; i <= THREADS; i++)
+    if(tags[i] != i + 1)
+      corrupt = 1;
+  if(corrupt)
+    MESSAGE("* ERROR: Objects of different threads overlap\n");
+  else
+    MESSAGE("Test passed OK\n");
+  return 0;
+}
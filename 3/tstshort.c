@@ -0,0 +1,106 @@
+/*
+ * Checks lifetime-hinted allocation: short-lived objects allocated in
+ * between long-lived ones are kept apart from them, and the memory they
+ * took is given back once they are all freed.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include "malloc.h"
+#include "tst.h"
+
+#define TIMES 4000
+#define LONGSIZE 64
+#define SHORTSIZE 1000
+
+char *longp[TIMES], *shortp[TIMES];
+
+static int seen_short;
+
+static int walker(void *block, size_t size, int used, void *ctx){
+  int i;
+
+  for(i = 0; i < TIMES; i++)
+    if ((char *) shortp[i] > (char *) block && (char *) shortp[i] < (char *) block + size)
+      seen_short++;
+  return 0;
+}
+
+int main(int argc, char *argv[]){
+  size_t before, during, after;
+  int i, errors = 0;
+  char *progname;
+
+  if (argc > 0)
+    progname = argv[0];
+  else
+    progname = "";
+
+  MESSAGE("-- Test lifetime-hinted allocation\n");
+  before = malloc_footprint();
+  for(i = 0; i < TIMES; i++){
+    longp[i] = malloc(LONGSIZE);
+    shortp[i] = malloc_hint(SHORTSIZE, MALLOC_SHORT_LIVED);
+    if (longp[i] == NULL || shortp[i] == NULL){
+      MESSAGE("* ERROR: malloc_hint returned NULL\n");
+      return 1;
+    }
+    if ((unsigned long) shortp[i] % 16 != 0)
+      errors++;
+    memset(longp[i], i, LONGSIZE);
+    memset(shortp[i], i, SHORTSIZE);
+  }
+  if (errors)
+    MESSAGE("* ERROR: Short-lived objects are not aligned\n");
+
+  for(i = 0; i < TIMES; i++)
+    if (longp[i][LONGSIZE-1] != (char) i || shortp[i][0] != (char) i ||
+        shortp[i][SHORTSIZE-1] != (char) i){
+      MESSAGE("* ERROR: Objects overlap\n");
+      errors++;
+      break;
+    }
+
+  malloc_walk(walker, NULL);
+  if (seen_short){
+    MESSAGE("* ERROR: Short-lived objects lie between long-lived ones\n");
+    errors++;
+  }
+
+  MESSAGE("Grow short-lived objects with realloc\n");
+  for(i = 0; i < TIMES; i += 2)
+    if ((shortp[i] = realloc(shortp[i], 2 * SHORTSIZE)) == NULL ||
+        shortp[i][SHORTSIZE-1] != (char) i){
+      MESSAGE("* ERROR: realloc lost the contents\n");
+      errors++;
+      break;
+    }
+  seen_short = 0;
+  malloc_walk(walker, NULL);
+  if (seen_short){
+    MESSAGE("* ERROR: realloc moved short-lived objects to the main heap\n");
+    errors++;
+  }
+
+  MESSAGE("Free the short-lived objects\n");
+  during = malloc_footprint();
+  for(i = 0; i < TIMES; i++)
+    free(shortp[i]);
+  after = malloc_footprint();
+  fprintf(stderr, "%s: footprint %lu before, %lu with, %lu after the short-lived objects\n",
+          progname, (unsigned long) before, (unsigned long) during, (unsigned long) after);
+  if (after - before > 2 * TIMES * LONGSIZE + 128 * 1024){
+    MESSAGE("* ERROR: Memory of freed short-lived objects was not given back\n");
+    errors++;
+  }
+
+  for(i = 0; i < TIMES; i++)
+    if (longp[i][0] != (char) i){
+      MESSAGE("* ERROR: Long-lived objects were overwritten\n");
+      errors++;
+      break;
+    }
+  if (errors == 0)
+    MESSAGE("Test passed OK\n");
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ * Walks the arena with malloc_walk() after a mixed workload and checks
+ * that the blocks are reported in address order without overlap, that
+ * every live allocation lies in a used block and that no two free blocks
+ * touch (they should have been merged).  Saves the snapshot, loads it
+ * back and checks it is the same.  Prints a fragmentation map.
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "malloc.h"
+#include "heapmap.h"
+#include "tst.h"
+
+#define SIZE 256
+#define SMALLSTRING 64
+#define MAXBLOCKS 4096
+
+heapblock blocks[MAXBLOCKS], loaded[MAXBLOCKS];
+
+int main(int argc, char *argv[]){
+  int i, j, errors = 0;
+  char *a[SIZE];
+  heapsnap hs, ls;
+  FILE *fp;
+  char *progname;
+
+  if (argc > 0)
+    progname = argv[0];
+  else
+    progname = "";
+
+  MESSAGE("-- Test walking the arena with malloc_walk()\n");
+  for(i = 0; i < SIZE; i++)
+    a[i] = malloc(SMALLSTRING * (1 + i % 7));
+  for(i = 0; i < SIZE; i += 3){
+    free(a[i]);
+    a[i] = NULL;
+  }
+  for(i = 1; i < SIZE; i += 9)
+    a[i] = realloc(a[i], 4096);
+
+  heapmap_snapshot(&hs, blocks, MAXBLOCKS);
+  if (hs.n == 0 || hs.truncated)
+    MESSAGE("* ERROR: Snapshot is empty or truncated\n");
+
+  for(i = 1; i < hs.n; i++){
+    if (blocks[i].addr < blocks[i-1].addr + blocks[i-1].size){
+      MESSAGE("* ERROR: Blocks out of order or overlapping\n");
+      errors++;
+    }
+    if (!blocks[i].used && !blocks[i-1].used &&
+	blocks[i].addr == blocks[i-1].addr + blocks[i-1].size){
+      MESSAGE("* ERROR: Adjacent free blocks were not merged\n");
+      errors++;
+    }
+  }
+
+  for(i = 0; i < SIZE; i++){
+    unsigned long p = (unsigned long) a[i];
+    if (a[i] == NULL)
+      continue;
+    for(j = 0; j < hs.n; j++)
+      if (p > blocks[j].addr && p < blocks[j].addr + blocks[j].size)
+	break;
+    if (j == hs.n || !blocks[j].used){
+      MESSAGE("* ERROR: Live allocation not in a used block\n");
+      errors++;
+    }
+  }
+
+  MESSAGE("Save the snapshot and load it again\n");
+  if ((fp = tmpfile()) == NULL || heapmap_save(fp, &hs) < 0){
+    MESSAGE("* ERROR: Could not save the snapshot\n");
+    errors++;
+  } else {
+    rewind(fp);
+    heapmap_load(fp, &ls, loaded, MAXBLOCKS);
+    for(i = 0; i < ls.n && i < hs.n; i++)
+      if (loaded[i].addr != blocks[i].addr || loaded[i].size != blocks[i].size ||
+          loaded[i].used != blocks[i].used)
+        break;
+    if (ls.n != hs.n || i != hs.n || ls.truncated){
+      MESSAGE("* ERROR: Loaded snapshot differs from the saved one\n");
+      errors++;
+    }
+  }
+  if (fp != NULL)
+    fclose(fp);
+
+  heapmap_render(stderr, &hs, 256, 64);
+  if (errors == 0)
+    MESSAGE("Test passed OK\n");
+  return 0;
+}
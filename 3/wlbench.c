@@ -0,0 +1,214 @@
+/*
+ *
+ * NAME:
+ *   wlbench  -  replay reproducible workloads against malloc.c
+ *
+ * SYNTAX:
+ *   wlbench [-s strategy] [-S seed] [-n ops] [-m maxlive] [-z sizes]
+ *           [-l lifetimes] [-g growth] [-H life] [-r repeats]
+ *           [-p source] [-M name] [-P]
+ *
+ * DESCRIPTION:
+ *   wlbench generates a trace of malloc/realloc/free operations from a
+ *   fixed seed and replays it against the allocator, printing throughput,
+ *   peak live bytes and how much memory the allocator obtained.  The same options always
+ *   give the same trace, so runs with different strategies are comparable.
+ *
+ * OPTIONS:
+ *   -s strategy   1 first fit, 2 best fit, 3 worst fit, 4 quick fit
+ *   -S seed       seed for the generator (default 4711)
+ *   -n ops        number of operations (default 100000)
+ *   -m maxlive    objects alive at most (default 2000)
+ *   -z dist       request sizes in bytes (default uniform:8:16384)
+ *   -l dist       lifetimes in operations (default uniform:1:4000)
+ *   -g growth     realloc pattern: none, linear:RATE:STEP[:MAX] or
+ *                 double:RATE[:MAX] (default none)
+ *   -H life       allocate objects that live fewer than life operations
+ *                 with malloc_hint(size, MALLOC_SHORT_LIVED)
+ *   -r repeats    replay the trace this many times (default 1)
+ *   -p source     where the heap gets memory: sbrk, mmap, region:BYTES or
+ *                 hugetlb:DIR (default sbrk)
+ *   -M name       print one machine-readable line for the workload called
+ *                 name instead of one line per run: best throughput and
+ *                 the most memory consumed over all repeats
+ *   -P            count cycles, instructions, L1d/LLC and dTLB misses with
+ *                 perf_event_open around every run and print them per
+ *                 operation (software counters if the hardware ones are
+ *                 not available); with -M they go to stderr
+ *
+ *   A dist is uniform:MIN:MAX, powerlaw:MIN:MAX:ALPHA, bimodal:MIN:MAX:P
+ *   or hist:FILE, where FILE holds "size count" lines.
+ *
+ * EXAMPLES:
+ *   wlbench -s 2 -z powerlaw:16:65536:1.5 -l powerlaw:1:100000:1.1
+ *   wlbench -s 1 -z bimodal:32:8192:0.05 -g double:0.01:262144
+ *   wlbench -p region:268435456
+ *   wlbench -s 1 -l bimodal:10:100000:0.1 -H 1000
+ *
+ *   The -M line has the columns
+ *
+ *     name strategy source ops ops/s peak_live consumed ratio failed
+ *
+ *   where ratio is consumed / peak_live.  RUN_GATE compares these
+ *   against the numbers in baselines.
+ *
+ * NOTES:
+ *   wlbench must be linked with a malloc.o built without -DSTRATEGY so
+ *   the strategy can be chosen at run time (see malloc_rt.o in Makefile).
+ *
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "malloc.h"
+#include "workload.h"
+#include "perfctr.h"
+
+extern int STRATEGY;
+
+/* print_counters:  counters of one run, per operation */
+static void print_counters(FILE *fp, perfctr *pc, long nops) {
+    int i;
+
+    fprintf(fp, "  %s counters per op:", pc->software ? "software" : "hardware");
+    for (i = 0; i < pc->n; i++)
+        fprintf(fp, " %s %.2f", pc->name[i], (double) pc->value[i] / nops);
+    fprintf(fp, "\n");
+}
+
+/* set_source:  switch the heap to the page source in spec */
+static int set_source(const char *spec) {
+    unsigned long size;
+    void *region;
+
+    if (strcmp(spec, "sbrk") == 0)
+        return malloc_pages(MALLOC_PAGES_SBRK);
+    if (strcmp(spec, "mmap") == 0)
+        return malloc_pages(MALLOC_PAGES_MMAP);
+    if (strncmp(spec, "hugetlb:", 8) == 0)
+        return malloc_pages_hugetlb(spec + 8);
+    if (sscanf(spec, "region:%lu", &size) == 1) {
+        region = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+        if (region == MAP_FAILED)
+            return -1;
+        return malloc_pages_region(region, size);
+    }
+    return -1;
+}
+
+static void usage(char *progname) {
+
+    fprintf(stderr, "usage: %s [-s strategy] [-S seed] [-n ops] [-m maxlive] "
+            "[-z sizes] [-l lifetimes] [-g growth] [-H life] [-r repeats] "
+            "[-p source] [-M name] [-P]\n", progname);
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+    wl_config c;
+    wl_trace t;
+    wl_result r;
+    char *source = "sbrk", *name = NULL;
+    perfctr pc;
+    int counters = 0;
+    double best = 0;
+    long consumed = 0, failed = 0;
+    int opt, repeats = 1, i;
+
+    wl_defaults(&c);
+    while ((opt = getopt(argc, argv, "s:S:n:m:z:l:g:H:r:p:M:P")) != -1) {
+        switch (opt) {
+            case 's':
+                STRATEGY = atoi(optarg);
+                break;
+            case 'S':
+                c.seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'n':
+                c.nops = atol(optarg);
+                break;
+            case 'm':
+                c.maxlive = atoi(optarg);
+                break;
+            case 'z':
+                if (wl_parse_dist(&c.size, optarg) < 0)
+                    usage(argv[0]);
+                break;
+            case 'l':
+                if (wl_parse_dist(&c.life, optarg) < 0)
+                    usage(argv[0]);
+                break;
+            case 'g':
+                if (wl_parse_grow(&c, optarg) < 0)
+                    usage(argv[0]);
+                break;
+            case 'H':
+                c.short_life = atol(optarg);
+                break;
+            case 'r':
+                repeats = atoi(optarg);
+                break;
+            case 'p':
+                source = optarg;
+                break;
+            case 'M':
+                name = optarg;
+                break;
+            case 'P':
+                counters = 1;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    if (STRATEGY < 1 || STRATEGY > 4 || c.nops <= 0 || c.maxlive <= 0 || repeats <= 0)
+        usage(argv[0]);
+
+    if (set_source(source) < 0) {
+        perror(source);
+        return 1;
+    }
+    if (wl_generate(&c, &t) < 0) {
+        perror("wl_generate");
+        return 1;
+    }
+    if (counters && pc_open(&pc) == 0) {
+        fprintf(stderr, "%s: no performance counters available\n", argv[0]);
+        counters = 0;
+    }
+    for (i = 0; i < repeats; i++) {
+        if (counters)
+            pc_start(&pc);
+        wl_run(&t, &r);
+        if (counters)
+            pc_stop(&pc);
+        if (r.nops / r.seconds > best)
+            best = r.nops / r.seconds;
+        if (r.consumed > consumed)
+            consumed = r.consumed;
+        failed += r.failed;
+        if (name != NULL) {
+            if (counters)
+                print_counters(stderr, &pc, r.nops);
+            continue;
+        }
+        printf("%s strategy %d seed %llu run %d: %ld ops in %.3f s (%.0f ops/s), "
+                "peak live %lu, consumed %ld (%.2f), failed %ld\n",
+                source, STRATEGY, c.seed, i, r.nops, r.seconds, r.nops / r.seconds,
+                (unsigned long) r.peak_live, r.consumed,
+                r.peak_live ? (double) r.consumed / r.peak_live : 0.0, r.failed);
+        if (counters)
+            print_counters(stdout, &pc, r.nops);
+    }
+    if (counters)
+        pc_close(&pc);
+    if (name != NULL)
+        printf("%s %d %s %ld %.0f %lu %ld %.4f %ld\n", name, STRATEGY, source,
+                r.nops, best, (unsigned long) r.peak_live, consumed,
+                r.peak_live ? (double) consumed / r.peak_live : 0.0, failed);
+    wl_release(&t);
+    return 0;
+}
@@ -0,0 +1,352 @@
+/*
+ * workload.c -- reproducible allocator workloads, see workload.h
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "malloc.h"
+#include "workload.h"
+
+/* wl_next:  xorshift64* generator, same sequence on every platform */
+static unsigned long long wl_next(unsigned long long *s) {
+
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 2685821657736338717ULL;
+}
+
+/* wl_unit:  uniform double in [0, 1) */
+static double wl_unit(unsigned long long *s) {
+
+    return (wl_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* wl_sample:  draw one value from distribution d */
+static size_t wl_sample(const wl_dist *d, unsigned long long *s) {
+    double u, a, lo, hi;
+    int i;
+
+    switch (d->kind) {
+        case WL_POWERLAW:
+            u = wl_unit(s);
+            lo = d->min;
+            hi = d->max;
+            if (d->alpha == 1.0)
+                return (size_t) (lo * pow(hi / lo, u));
+            a = 1.0 - d->alpha;
+            return (size_t) pow(pow(lo, a) + u * (pow(hi, a) - pow(lo, a)), 1.0 / a);
+        case WL_BIMODAL:
+            return wl_unit(s) < d->p ? d->max : d->min;
+        case WL_HISTOGRAM:
+            u = wl_unit(s);
+            for (i = 0; i < d->nbins - 1 && d->cum[i] <= u; i++)
+                ;
+            return d->bin[i];
+        default:
+            return d->min + wl_next(s) % (d->max - d->min + 1);
+    }
+}
+
+/* wl_load_hist:  read "value count" lines into d */
+static int wl_load_hist(wl_dist *d, const char *path) {
+    FILE *fp;
+    unsigned long v;
+    double c, total = 0;
+    int i;
+
+    if ((fp = fopen(path, "r")) == NULL)
+        return -1;
+    d->kind = WL_HISTOGRAM;
+    d->nbins = 0;
+    while (d->nbins < WL_MAXBINS && fscanf(fp, "%lu %lf", &v, &c) == 2) {
+        if (v == 0 || c <= 0)
+            continue;
+        d->bin[d->nbins] = v;
+        d->cum[d->nbins] = total += c;
+        d->nbins++;
+    }
+    fclose(fp);
+    if (d->nbins == 0)
+        return -1;
+    for (i = 0; i < d->nbins; i++)
+        d->cum[i] /= total;
+    return 0;
+}
+
+/*
+ * wl_parse_dist:  fill d from a spec of the form
+ *
+ *   uniform:MIN:MAX  powerlaw:MIN:MAX:ALPHA  bimodal:MIN:MAX:P  hist:FILE
+ *
+ * returns 0 on success and -1 on a malformed spec.
+ */
+int wl_parse_dist(wl_dist *d, const char *spec) {
+    unsigned long lo, hi;
+    double x = 0;
+
+    if (strncmp(spec, "hist:", 5) == 0)
+        return wl_load_hist(d, spec + 5);
+    if (sscanf(spec, "uniform:%lu:%lu", &lo, &hi) == 2)
+        d->kind = WL_UNIFORM;
+    else if (sscanf(spec, "powerlaw:%lu:%lu:%lf", &lo, &hi, &x) == 3)
+        d->kind = WL_POWERLAW;
+    else if (sscanf(spec, "bimodal:%lu:%lu:%lf", &lo, &hi, &x) == 3)
+        d->kind = WL_BIMODAL;
+    else
+        return -1;
+    if (lo == 0 || hi < lo)
+        return -1;
+    d->min = lo;
+    d->max = hi;
+    d->alpha = x;
+    d->p = x;
+    return 0;
+}
+
+/* wl_parse_grow:  none, linear:RATE:STEP[:MAX] or double:RATE[:MAX] */
+int wl_parse_grow(wl_config *c, const char *spec) {
+    unsigned long step, max;
+    double rate;
+
+    max = c->grow_max;
+    if (strcmp(spec, "none") == 0) {
+        c->grow = WL_GROW_NONE;
+        c->grow_rate = 0;
+        return 0;
+    } else if (sscanf(spec, "linear:%lf:%lu:%lu", &rate, &step, &max) >= 2) {
+        c->grow = WL_GROW_LINEAR;
+        c->grow_step = step;
+    } else if (sscanf(spec, "double:%lf:%lu", &rate, &max) >= 1) {
+        c->grow = WL_GROW_DOUBLE;
+    } else
+        return -1;
+    if (rate < 0 || rate >= 1)
+        return -1;
+    c->grow_rate = rate;
+    c->grow_max = max;
+    return 0;
+}
+
+/* wl_defaults:  the classic tstalgorithms mix with a fixed seed */
+void wl_defaults(wl_config *c) {
+
+    memset(c, 0, sizeof (*c));
+    c->seed = 4711;
+    c->nops = 100000;
+    c->maxlive = 2000;
+    c->size.kind = WL_UNIFORM;
+    c->size.min = 8;
+    c->size.max = 16384;
+    c->life.kind = WL_UNIFORM;
+    c->life.min = 1;
+    c->life.max = 4000;
+    c->grow = WL_GROW_NONE;
+    c->grow_max = 1 << 20;
+}
+
+/* wl_map:  zeroed memory that does not come from the arena under test */
+static void *wl_map(size_t n) {
+    void *p;
+
+    p = mmap(NULL, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return p == MAP_FAILED ? NULL : p;
+}
+
+/*
+ * Bookkeeping while generating: a min-heap of live slots ordered by time
+ * of death, a table of live slots to pick realloc victims from and a stack
+ * of unused slots.
+ */
+typedef struct {
+    long *death; /* per slot */
+    size_t *size; /* per slot */
+    int *heap, nheap;
+    int *live, *livepos, nlive;
+    int *unused, nunused;
+} wl_state;
+
+static void wl_heap_push(wl_state *st, int slot) {
+    int i = st->nheap++, parent;
+
+    while (i > 0 && st->death[st->heap[parent = (i - 1) / 2]] > st->death[slot]) {
+        st->heap[i] = st->heap[parent];
+        i = parent;
+    }
+    st->heap[i] = slot;
+}
+
+static int wl_heap_pop(wl_state *st) {
+    int top = st->heap[0], last = st->heap[--st->nheap], i = 0, child;
+
+    while ((child = 2 * i + 1) < st->nheap) {
+        if (child + 1 < st->nheap &&
+                st->death[st->heap[child + 1]] < st->death[st->heap[child]])
+            child++;
+        if (st->death[st->heap[child]] >= st->death[last])
+            break;
+        st->heap[i] = st->heap[child];
+        i = child;
+    }
+    st->heap[i] = last;
+    return top;
+}
+
+/* wl_kill:  emit the free of slot and recycle it */
+static void wl_kill(wl_state *st, wl_trace *t, int slot) {
+    int pos = st->livepos[slot];
+
+    st->live[pos] = st->live[--st->nlive];
+    st->livepos[st->live[pos]] = pos;
+    st->unused[st->nunused++] = slot;
+    t->ops[t->nops].op = WL_FREE;
+    t->ops[t->nops].slot = slot;
+    t->ops[t->nops].size = 0;
+    t->nops++;
+}
+
+/* wl_generate:  build the trace for c, returns 0 or -1 if out of memory */
+int wl_generate(const wl_config *c, wl_trace *t) {
+    unsigned long long s;
+    wl_state st;
+    size_t statesize;
+    char *mem;
+    long now, life;
+    int slot, i;
+    size_t n;
+
+    t->nslots = c->maxlive;
+    t->nops = 0;
+    t->maxops = c->nops + c->maxlive + 2;
+    t->ops = wl_map(t->maxops * sizeof (wl_op));
+    statesize = c->maxlive * (sizeof (long) + sizeof (size_t) + 4 * sizeof (int));
+    if (t->ops == NULL || (mem = wl_map(statesize)) == NULL)
+        return -1;
+    st.death = (long *) mem;
+    st.size = (size_t *) (st.death + c->maxlive);
+    st.heap = (int *) (st.size + c->maxlive);
+    st.live = st.heap + c->maxlive;
+    st.livepos = st.live + c->maxlive;
+    st.unused = st.livepos + c->maxlive;
+    st.nheap = st.nlive = 0;
+    for (i = 0; i < c->maxlive; i++)
+        st.unused[i] = c->maxlive - 1 - i;
+    st.nunused = c->maxlive;
+
+    s = c->seed ? c->seed : 0x9e3779b97f4a7c15ULL;
+    for (now = 0; t->nops < c->nops; now++) {
+        while (st.nheap > 0 && st.death[st.heap[0]] <= now && t->nops < c->nops)
+            wl_kill(&st, t, wl_heap_pop(&st));
+        if (t->nops >= c->nops)
+            break;
+
+        if (st.nlive > 0 && c->grow != WL_GROW_NONE && wl_unit(&s) < c->grow_rate) {
+            slot = st.live[wl_next(&s) % st.nlive];
+            n = c->grow == WL_GROW_DOUBLE ? 2 * st.size[slot] : st.size[slot] + c->grow_step;
+            if (n > c->grow_max)
+                n = c->grow_max;
+            st.size[slot] = n;
+            t->ops[t->nops].op = WL_REALLOC;
+            t->ops[t->nops].slot = slot;
+            t->ops[t->nops].size = n;
+            t->nops++;
+            continue;
+        }
+
+        if (st.nunused == 0) /* too many alive, the oldest due dies early */
+            wl_kill(&st, t, wl_heap_pop(&st));
+        slot = st.unused[--st.nunused];
+        st.size[slot] = wl_sample(&c->size, &s);
+        life = wl_sample(&c->life, &s);
+        st.death[slot] = now + 1 + life;
+        wl_heap_push(&st, slot);
+        st.livepos[slot] = st.nlive;
+        st.live[st.nlive++] = slot;
+        t->ops[t->nops].op = life < c->short_life ? WL_MALLOC_SHORT : WL_MALLOC;
+        t->ops[t->nops].slot = slot;
+        t->ops[t->nops].size = st.size[slot];
+        t->nops++;
+    }
+    while (st.nheap > 0) /* leave nothing behind */
+        wl_kill(&st, t, wl_heap_pop(&st));
+
+    munmap(mem, statesize);
+    return 0;
+}
+
+/* wl_run:  replay trace t against malloc, returns the number of failures */
+int wl_run(const wl_trace *t, wl_result *r) {
+    struct timespec t0, t1;
+    char **slot, *p;
+    size_t *size, live = 0, footprint0;
+    wl_op *op;
+    long i;
+
+    slot = wl_map(t->nslots * sizeof (char *));
+    size = wl_map(t->nslots * sizeof (size_t));
+    if (slot == NULL || size == NULL)
+        return -1;
+    memset(r, 0, sizeof (*r));
+
+    footprint0 = malloc_footprint();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (i = 0; i < t->nops; i++) {
+        op = &t->ops[i];
+        switch (op->op) {
+            case WL_MALLOC:
+            case WL_MALLOC_SHORT:
+                if (op->op == WL_MALLOC)
+                    p = malloc(op->size);
+                else
+                    p = malloc_hint(op->size, MALLOC_SHORT_LIVED);
+                if (p == NULL) {
+                    r->failed++;
+                    break;
+                }
+                p[0] = p[op->size - 1] = (char) i; /* touch it */
+                slot[op->slot] = p;
+                size[op->slot] = op->size;
+                live += op->size;
+                break;
+            case WL_REALLOC:
+                if ((p = realloc(slot[op->slot], op->size)) == NULL) {
+                    r->failed++;
+                    break;
+                }
+                p[op->size - 1] = (char) i;
+                slot[op->slot] = p;
+                live += op->size - size[op->slot];
+                size[op->slot] = op->size;
+                break;
+            case WL_FREE:
+                free(slot[op->slot]);
+                slot[op->slot] = NULL;
+                live -= size[op->slot];
+                size[op->slot] = 0;
+                break;
+        }
+        if (live > r->peak_live)
+            r->peak_live = live;
+        if (malloc_footprint() - footprint0 > (size_t) r->consumed)
+            r->consumed = malloc_footprint() - footprint0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    r->nops = t->nops;
+    r->seconds = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    munmap(slot, t->nslots * sizeof (char *));
+    munmap(size, t->nslots * sizeof (size_t));
+    return r->failed;
+}
+
+/* wl_release:  drop the trace */
+void wl_release(wl_trace *t) {
+
+    if (t->ops != NULL)
+        munmap(t->ops, t->maxops * sizeof (wl_op));
+    t->ops = NULL;
+}
@@ -0,0 +1,82 @@
+#ifndef _workload_h_
+#define _workload_h_
+
+#include <stddef.h>
+
+/*
+ * Reproducible allocator workloads.  A workload is described by a
+ * wl_config and turned into a trace of malloc/realloc/free operations by
+ * wl_generate().  Generation depends only on the config (seed included),
+ * so the same trace can be replayed against every STRATEGY.  Traces and
+ * slot tables live in their own mappings and never touch the arena under
+ * test.
+ */
+
+#define WL_UNIFORM   1 /* uniform in [min, max] */
+#define WL_POWERLAW  2 /* bounded power law on [min, max], exponent alpha */
+#define WL_BIMODAL   3 /* min with chance 1-p, max with chance p */
+#define WL_HISTOGRAM 4 /* sampled from a "value count" histogram file */
+
+#define WL_MAXBINS 256
+
+typedef struct {
+    int kind;
+    size_t min, max;
+    double alpha; /* power-law exponent */
+    double p; /* bimodal: chance of drawing max */
+    int nbins; /* histogram */
+    size_t bin[WL_MAXBINS];
+    double cum[WL_MAXBINS]; /* cumulative probability */
+} wl_dist;
+
+#define WL_GROW_NONE   0
+#define WL_GROW_LINEAR 1 /* grow by step bytes */
+#define WL_GROW_DOUBLE 2 /* double the size */
+
+typedef struct {
+    unsigned long long seed;
+    long nops; /* operations to generate */
+    int maxlive; /* objects alive at most */
+    wl_dist size; /* request sizes in bytes */
+    wl_dist life; /* lifetimes in operations */
+    int grow; /* WL_GROW_* realloc pattern */
+    double grow_rate; /* chance an operation reallocs a live object */
+    size_t grow_step;
+    size_t grow_max; /* objects are not grown beyond this */
+    long short_life; /* lifetimes below this are hinted short-lived */
+} wl_config;
+
+#define WL_MALLOC  1
+#define WL_REALLOC 2
+#define WL_FREE    3
+#define WL_MALLOC_SHORT 4 /* malloc_hint(size, MALLOC_SHORT_LIVED) */
+
+typedef struct {
+    int op;
+    int slot;
+    size_t size;
+} wl_op;
+
+typedef struct {
+    wl_op *ops;
+    long nops;
+    long maxops; /* room in ops */
+    int nslots;
+} wl_trace;
+
+typedef struct {
+    long nops;
+    double seconds;
+    size_t peak_live; /* most bytes requested and not yet freed */
+    long consumed; /* most malloc_footprint() grew during the run */
+    long failed; /* requests that returned NULL */
+} wl_result;
+
+extern void wl_defaults(wl_config *);
+extern int wl_parse_dist(wl_dist *, const char *);
+extern int wl_parse_grow(wl_config *, const char *);
+extern int wl_generate(const wl_config *, wl_trace *);
+extern int wl_run(const wl_trace *, wl_result *);
+extern void wl_release(wl_trace *);
+
+#endif